@@ -0,0 +1,162 @@
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "uring/uring.h"
+
+constexpr unsigned kThreads = 16;
+constexpr unsigned kQueueDepth = 32;
+constexpr unsigned kBlockSize = 4096;
+constexpr unsigned kWritesPerThread = 16384;
+constexpr uint64_t kFileSize = 16 * 1024 * 1024;
+
+static unsigned count_threads() {
+  DIR* dir = ::opendir("/proc/self/task");
+  if (!dir) {
+    return 0;
+  }
+
+  unsigned nr = 0;
+  while (const dirent* ent = ::readdir(dir)) {
+    if (ent->d_name[0] != '.') {
+      ++nr;
+    }
+  }
+  ::closedir(dir);
+  return nr;
+}
+
+static int open_tmp() {
+  char path[] = "/tmp/bench_attach_wq.XXXXXX";
+  const int fd = ::mkstemp(path);
+  if (fd < 0) {
+    throw std::system_error{errno, std::system_category(), "mkstemp"};
+  }
+  ::unlink(path);
+  return fd;
+}
+
+/*
+ * Keep kQueueDepth buffered writes in flight, all forced to io-wq with
+ * IOSQE_ASYNC, until kWritesPerThread of them have completed.
+ */
+template <unsigned uring_flags>
+static void writer(liburing::uring<uring_flags>& ring, const int fd) {
+  static const std::vector<char> buf(kBlockSize, 'x');
+  unsigned queued = 0, done = 0;
+  uint64_t offset = 0;
+
+  while (done < kWritesPerThread) {
+    while (queued < kWritesPerThread && queued - done < kQueueDepth) {
+      liburing::sqe* sqe = ring.get_sqe();
+      if (!sqe) {
+        break;
+      }
+      sqe->prep_write(fd, buf, offset);
+      sqe->set_async();
+      offset = (offset + kBlockSize) % kFileSize;
+      ++queued;
+    }
+
+    const liburing::cqe* cqe;
+    if (const int ret = ring.submit_and_wait(1); ret < 0) {
+      throw std::system_error{-ret, std::system_category(), "submit_and_wait"};
+    }
+    if (const int ret = ring.wait_cqe(cqe); ret < 0) {
+      throw std::system_error{-ret, std::system_category(), "wait_cqe"};
+    }
+    done += ring.for_each_and_advance([](const liburing::cqe* cqe) {
+      if (cqe->res < 0) {
+        throw std::system_error{-cqe->res, std::system_category(), "write"};
+      }
+    });
+  }
+}
+
+template <unsigned uring_flags>
+static void run(const char* name) {
+  constexpr bool kAttach = uring_flags & IORING_SETUP_ATTACH_WQ;
+
+  liburing::uring<uring_flags & ~IORING_SETUP_ATTACH_WQ> owner;
+  owner.init(kQueueDepth);
+
+  std::atomic<bool> stop{false};
+  std::vector<std::thread> threads;
+  threads.reserve(kThreads);
+
+  const auto start = std::chrono::steady_clock::now();
+  for (unsigned i = 0; i < kThreads; ++i) {
+    threads.emplace_back([&owner] {
+      liburing::uring<uring_flags> ring;
+      if constexpr (kAttach) {
+        ring.init(kQueueDepth, owner);
+      } else {
+        ring.init(kQueueDepth);
+      }
+
+      const int fd = open_tmp();
+      try {
+        writer(ring, fd);
+      } catch (const std::system_error& e) {
+        std::cerr << e.what() << "\n" << e.code() << "\n";
+      }
+      ::close(fd);
+    });
+  }
+
+  unsigned peak = 0;
+  std::thread sampler{[&stop, &peak] {
+    while (!stop.load(std::memory_order_relaxed)) {
+      peak = std::max(peak, count_threads());
+      std::this_thread::sleep_for(std::chrono::milliseconds{1});
+    }
+  }};
+
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  const std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  stop = true;
+  sampler.join();
+
+  const double bytes = double{kThreads} * kWritesPerThread * kBlockSize;
+  printf("%-20s %6u threads %10.1f MiB/s\n", name, peak,
+         bytes / elapsed.count() / (1 << 20));
+}
+
+/**
+ * Buffered IOSQE_ASYNC writes from kThreads threads with a ring each, every
+ * ring with its own async backend versus all attached to the one of a
+ * shared ring (IORING_SETUP_ATTACH_WQ), with and without SQPOLL. Reports
+ * the peak number of threads in the process, io-wq workers and SQPOLL
+ * threads included, and the write throughput.
+ *
+ * Since Linux 5.12, io-wq workers belong to the submitting task rather
+ * than to the ring, so attaching mostly pays off with SQPOLL, where all
+ * the attached rings share one poller thread.
+ *
+ *      ./bench_attach_wq
+ */
+int main() {
+  try {
+    run<0>("separate");
+    run<IORING_SETUP_ATTACH_WQ>("attached");
+    run<IORING_SETUP_SQPOLL>("sqpoll separate");
+    run<IORING_SETUP_SQPOLL | IORING_SETUP_ATTACH_WQ>("sqpoll attached");
+  } catch (const std::system_error& e) {
+    std::cerr << e.what() << "\n" << e.code() << "\n";
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << '\n';
+  }
+
+  return 0;
+}
@@ -0,0 +1,132 @@
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "uring/buf_ring.h"
+#include "uring/uring.h"
+
+constexpr unsigned kQueueDepth = 256;
+constexpr unsigned kEntries = 256;
+constexpr unsigned kBufSize = 4096;
+constexpr std::size_t kTotalBytes = std::size_t{1} << 31;
+constexpr uint16_t kBgid = 0;
+
+static void sender(const int fd) {
+  std::vector<char> buf(kBufSize * 16, 'x');
+  std::size_t sent = 0;
+
+  while (sent < kTotalBytes) {
+    const ssize_t n = ::write(fd, buf.data(), buf.size());
+    if (n <= 0) {
+      break;
+    }
+    sent += static_cast<std::size_t>(n);
+  }
+  ::shutdown(fd, SHUT_WR);
+}
+
+template <unsigned uring_flags, unsigned pbuf_flags>
+static void arm(liburing::uring<uring_flags>& ring,
+                liburing::buf_ring<uring_flags, pbuf_flags>& br,
+                const int fd) {
+  liburing::sqe* sqe = ring.get_sqe();
+  if (!sqe) {
+    throw std::system_error{EBUSY, std::system_category(), "get_sqe"};
+  }
+  sqe->prep_recv_multishot(fd, {}, 0);
+  sqe->set_buffer_select(br.bgid());
+  ring.submit();
+}
+
+/*
+ * Receive kTotalBytes through a multishot recv that picks its buffers from
+ * the ring, recycling each batch of buffers with a single tail update.
+ */
+template <unsigned pbuf_flags>
+static double run() {
+  liburing::uring<> ring;
+  ring.init(kQueueDepth);
+
+  liburing::buf_ring<0, pbuf_flags> br;
+  br.init(ring, kEntries, kBgid);
+
+  std::vector<char> pool(std::size_t{kEntries} * kBufSize);
+  br.provide(pool, kBufSize);
+
+  int sv[2];
+  if (::socketpair(AF_UNIX, SOCK_STREAM, 0, sv)) {
+    throw std::system_error{errno, std::system_category(), "socketpair"};
+  }
+
+  std::thread thread{sender, sv[1]};
+  const auto start = std::chrono::steady_clock::now();
+
+  arm(ring, br, sv[0]);
+  std::size_t received = 0;
+  bool done = false;
+  while (!done) {
+    const liburing::cqe* cqe;
+    if (const int ret = ring.wait_cqe(cqe); ret < 0) {
+      throw std::system_error{-ret, std::system_category(), "wait_cqe"};
+    }
+
+    bool rearm = false;
+    ring.for_each_and_advance([&](const liburing::cqe* cqe) noexcept {
+      if (cqe->res == 0) {
+        done = true;
+      } else if (cqe->res > 0) {
+        received += br.consume(cqe).size();
+        br.recycle(liburing::cqe_buffer_id(cqe));
+      }
+      if (!liburing::cqe_has_more(cqe)) {
+        rearm = true;
+      }
+    });
+    br.advance();
+
+    if (rearm && !done) {
+      arm(ring, br, sv[0]);
+    }
+  }
+
+  const std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+
+  thread.join();
+  ::close(sv[0]);
+  ::close(sv[1]);
+
+  if (received != kTotalBytes) {
+    throw std::runtime_error{"short receive"};
+  }
+
+  return static_cast<double>(received) / elapsed.count() / (1 << 20);
+}
+
+/**
+ * Multishot recv throughput over a unix socketpair, with the provided
+ * buffer ring allocated by the application versus by the kernel
+ * (IOU_PBUF_RING_MMAP).
+ *
+ *      ./bench_buf_ring
+ */
+int main() {
+  try {
+    run<0>();  // warm up
+
+    printf("%-24s %10.1f MiB/s\n", "user-allocated", run<0>());
+    printf("%-24s %10.1f MiB/s\n", "IOU_PBUF_RING_MMAP",
+           run<IOU_PBUF_RING_MMAP>());
+  } catch (const std::system_error& e) {
+    std::cerr << e.what() << "\n" << e.code() << "\n";
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << '\n';
+  }
+
+  return 0;
+}
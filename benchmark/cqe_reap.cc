@@ -0,0 +1,118 @@
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+
+#include "uring/uring.h"
+
+constexpr std::size_t kQueueDepth = 4096;
+constexpr std::size_t kBatchSize = 512;
+constexpr std::size_t kRounds = 4096;
+
+enum class reap_mode : uint8_t {
+  SEEN_CQE,
+  PEEK_BATCH,
+  FOR_EACH_AND_ADVANCE,
+};
+
+template <unsigned uring_flags>
+static void fill(liburing::uring<uring_flags>& ring) {
+  for (std::size_t i = 0; i < kBatchSize; ++i) {
+    liburing::sqe* sqe = ring.get_sqe();
+    if (!sqe) {
+      throw std::system_error{-1, std::system_category(), "get_sqe"};
+    }
+    sqe->prep_nop();
+    sqe->set_data(i);
+  }
+
+  if (const int ret = ring.submit_and_wait(kBatchSize); ret < 0) {
+    throw std::system_error{-ret, std::system_category(), "submit_and_wait"};
+  }
+}
+
+template <unsigned uring_flags>
+static unsigned reap(liburing::uring<uring_flags>& ring, const reap_mode mode,
+                     uint64_t& total) {
+  unsigned reaped = 0;
+  uint64_t sum = 0;
+
+  switch (mode) {
+    case reap_mode::SEEN_CQE: {
+      const liburing::cqe* cqe;
+      while (!ring.peek_cqe(cqe)) {
+        sum += cqe->user_data;
+        ring.seen_cqe(cqe);
+        ++reaped;
+      }
+      break;
+    }
+    case reap_mode::PEEK_BATCH: {
+      std::array<const liburing::cqe*, kBatchSize> cqes{};
+      while (const unsigned nr = ring.peek_batch_cqe(cqes)) {
+        for (unsigned i = 0; i < nr; ++i) {
+          sum += cqes[i]->user_data;
+        }
+        ring.cq_advance(nr);
+        reaped += nr;
+      }
+      break;
+    }
+    case reap_mode::FOR_EACH_AND_ADVANCE:
+      reaped = ring.for_each_and_advance(
+          [&sum](const liburing::cqe* cqe) noexcept { sum += cqe->user_data; });
+      break;
+  }
+
+  total += sum;
+  return reaped;
+}
+
+template <unsigned uring_flags>
+static double run(liburing::uring<uring_flags>& ring, const reap_mode mode) {
+  std::chrono::nanoseconds elapsed{};
+  uint64_t reaped = 0, sum = 0;
+
+  for (std::size_t round = 0; round < kRounds; ++round) {
+    fill(ring);
+
+    const auto start = std::chrono::steady_clock::now();
+    reaped += reap(ring, mode, sum);
+    elapsed += std::chrono::steady_clock::now() - start;
+  }
+
+  if (reaped != kRounds * kBatchSize || !sum) {
+    throw std::runtime_error{"lost completions"};
+  }
+
+  return static_cast<double>(elapsed.count()) / static_cast<double>(reaped);
+}
+
+/**
+ * Cost of retiring a CQE when the head is committed once per completion
+ * (seen_cqe) versus once per batch (peek_batch_cqe + cq_advance,
+ * for_each_and_advance).
+ *
+ *      ./bench_cqe_reap
+ */
+int main() {
+  liburing::uring<IORING_SETUP_NO_SQARRAY> ring;
+  ring.init(kQueueDepth);
+
+  try {
+    run(ring, reap_mode::SEEN_CQE);  // warm up
+
+    printf("%-24s %8.2f ns/cqe\n", "seen_cqe",
+           run(ring, reap_mode::SEEN_CQE));
+    printf("%-24s %8.2f ns/cqe\n", "peek_batch_cqe",
+           run(ring, reap_mode::PEEK_BATCH));
+    printf("%-24s %8.2f ns/cqe\n", "for_each_and_advance",
+           run(ring, reap_mode::FOR_EACH_AND_ADVANCE));
+  } catch (const std::system_error& e) {
+    std::cerr << e.what() << "\n" << e.code() << "\n";
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << '\n';
+  }
+
+  return 0;
+}
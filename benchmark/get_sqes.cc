@@ -0,0 +1,91 @@
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+
+#include "uring/uring.h"
+
+constexpr unsigned kQueueDepth = 256;
+constexpr unsigned kBatchSize = 64;
+constexpr std::size_t kNops = 1 << 20;
+
+enum class get_mode : uint8_t {
+  GET_SQE,
+  GET_SQES,
+};
+
+template <unsigned uring_flags>
+static void prepare(liburing::uring<uring_flags>& ring, const get_mode mode,
+                    const uint64_t base) {
+  switch (mode) {
+    case get_mode::GET_SQE:
+      for (unsigned i = 0; i < kBatchSize; ++i) {
+        liburing::sqe* sqe = ring.get_sqe();
+        if (!sqe) {
+          throw std::system_error{EBUSY, std::system_category(), "get_sqe"};
+        }
+        sqe->prep_nop();
+        sqe->set_data(base + i);
+      }
+      break;
+    case get_mode::GET_SQES: {
+      const auto sqes = ring.get_sqes(kBatchSize);
+      if (sqes[0].empty()) {
+        throw std::system_error{EBUSY, std::system_category(), "get_sqes"};
+      }
+      uint64_t data = base;
+      for (const auto span : sqes) {
+        for (liburing::sqe& sqe : span) {
+          sqe.prep_nop();
+          sqe.set_data(data++);
+        }
+      }
+      break;
+    }
+  }
+}
+
+template <unsigned uring_flags>
+static double run(liburing::uring<uring_flags>& ring, const get_mode mode) {
+  std::chrono::nanoseconds elapsed{};
+
+  for (std::size_t done = 0; done < kNops; done += kBatchSize) {
+    const auto start = std::chrono::steady_clock::now();
+    prepare(ring, mode, done);
+    elapsed += std::chrono::steady_clock::now() - start;
+
+    if (const int ret = ring.submit_and_wait(kBatchSize); ret < 0) {
+      throw std::system_error{-ret, std::system_category(), "submit_and_wait"};
+    }
+    if (ring.for_each_and_advance([](const liburing::cqe*) noexcept {}) !=
+        kBatchSize) {
+      throw std::runtime_error{"lost completions"};
+    }
+  }
+
+  return static_cast<double>(elapsed.count()) / kNops;
+}
+
+/**
+ * Cost of preparing 1M NOPs in batches of 64, reserving one SQE at a time
+ * (get_sqe) versus the whole batch at once (get_sqes). Only the time spent
+ * reserving and preparing SQEs is counted, not the submission.
+ *
+ *      ./bench_get_sqes
+ */
+int main() {
+  liburing::uring<IORING_SETUP_NO_SQARRAY> ring;
+  ring.init(kQueueDepth);
+
+  try {
+    run(ring, get_mode::GET_SQE);  // warm up
+
+    printf("%-12s %8.2f ns/sqe\n", "get_sqe", run(ring, get_mode::GET_SQE));
+    printf("%-12s %8.2f ns/sqe\n", "get_sqes", run(ring, get_mode::GET_SQES));
+  } catch (const std::system_error& e) {
+    std::cerr << e.what() << "\n" << e.code() << "\n";
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << '\n';
+  }
+
+  return 0;
+}
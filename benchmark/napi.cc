@@ -0,0 +1,217 @@
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "uring/uring.h"
+
+constexpr unsigned kQueueDepth = 8;
+constexpr std::size_t kMsgSize = 64;
+constexpr std::size_t kWarmup = 1000;
+constexpr std::size_t kIterations = 100000;
+constexpr unsigned kBusyPollUsec = 50;
+
+static void check(const int ret, const char* what) {
+  if (ret < 0) {
+    throw std::system_error{errno, std::system_category(), what};
+  }
+}
+
+static void set_nodelay(const int fd) {
+  const int one = 1;
+  check(::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)),
+        "setsockopt");
+}
+
+/*
+ * Blocking echo server, serving nr connections one after the other.
+ */
+static void echo(const int listen_fd, const unsigned nr) {
+  for (unsigned i = 0; i < nr; ++i) {
+    const int fd = ::accept(listen_fd, nullptr, nullptr);
+    if (fd < 0) {
+      return;
+    }
+    set_nodelay(fd);
+
+    std::array<char, kMsgSize> buf{};
+    while (true) {
+      const ssize_t n = ::recv(fd, buf.data(), buf.size(), MSG_WAITALL);
+      if (n <= 0 || ::send(fd, buf.data(), n, 0) != n) {
+        break;
+      }
+    }
+    ::close(fd);
+  }
+}
+
+static int listen_on(sockaddr_in& addr) {
+  const int listen_fd = ::socket(AF_INET, SOCK_STREAM, 0);
+  check(listen_fd, "socket");
+
+  const int one = 1;
+  check(::setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)),
+        "setsockopt");
+  socklen_t len = sizeof(addr);
+  check(::bind(listen_fd, reinterpret_cast<sockaddr*>(&addr), len), "bind");
+  check(::listen(listen_fd, 1), "listen");
+  check(::getsockname(listen_fd, reinterpret_cast<sockaddr*>(&addr), &len),
+        "getsockname");
+  return listen_fd;
+}
+
+static int connect_to(const sockaddr_in& addr) {
+  const int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+  check(fd, "socket");
+  check(::connect(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)),
+        "connect");
+  set_nodelay(fd);
+  return fd;
+}
+
+static sockaddr_in parse_addr(const char* ip, const char* port) {
+  sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(static_cast<uint16_t>(std::atoi(port)));
+  if (::inet_pton(AF_INET, ip, &addr.sin_addr) != 1) {
+    throw std::system_error{EINVAL, std::system_category(), "inet_pton"};
+  }
+  return addr;
+}
+
+template <unsigned uring_flags>
+static void round_trip(liburing::uring<uring_flags>& ring, const int fd,
+                       std::array<char, kMsgSize>& buf) {
+  liburing::sqe* sqe = ring.get_sqe();
+  if (!sqe) {
+    throw std::system_error{EBUSY, std::system_category(), "get_sqe"};
+  }
+  sqe->prep_send(fd, buf, 0);
+  sqe->set_io_link();
+  sqe = ring.get_sqe();
+  if (!sqe) {
+    throw std::system_error{EBUSY, std::system_category(), "get_sqe"};
+  }
+  sqe->prep_recv(fd, buf, MSG_WAITALL);
+
+  if (const int ret = ring.submit_and_wait(2); ret < 0) {
+    throw std::system_error{-ret, std::system_category(), "submit_and_wait"};
+  }
+  ring.for_each_and_advance([](const liburing::cqe* cqe) {
+    if (cqe->res < 0) {
+      throw std::system_error{-cqe->res, std::system_category(), "send/recv"};
+    }
+  });
+}
+
+static void run(const char* name, const bool napi, const sockaddr_in& peer) {
+  liburing::uring<> ring;
+  ring.init(kQueueDepth);
+
+  if (napi) {
+    if (const int ret = ring.register_napi(kBusyPollUsec, true); ret < 0) {
+      throw std::system_error{-ret, std::system_category(), "register_napi"};
+    }
+  }
+
+  const int fd = connect_to(peer);
+
+  std::array<char, kMsgSize> buf{};
+  std::vector<std::chrono::nanoseconds> samples(kIterations);
+  for (std::size_t i = 0; i < kWarmup; ++i) {
+    round_trip(ring, fd, buf);
+  }
+  for (std::size_t i = 0; i < kIterations; ++i) {
+    const auto start = std::chrono::steady_clock::now();
+    round_trip(ring, fd, buf);
+    samples[i] = std::chrono::steady_clock::now() - start;
+  }
+
+  ::shutdown(fd, SHUT_RDWR);
+  ::close(fd);
+
+  std::sort(samples.begin(), samples.end());
+  const auto percentile = [&samples](const double p) {
+    const auto i = static_cast<std::size_t>(p * (samples.size() - 1));
+    return static_cast<double>(samples[i].count()) / 1000.0;
+  };
+  printf("%-16s p50 %8.2f us  p99 %8.2f us  p99.9 %8.2f us\n", name,
+         percentile(0.5), percentile(0.99), percentile(0.999));
+}
+
+/**
+ * Round-trip latency of a 64 byte request/response over TCP, with the
+ * client ring sleeping until completions arrive versus busy polling the
+ * socket's NAPI context (IORING_REGISTER_NAPI) while it waits.
+ *
+ * NAPI ids only exist on sockets that receive through a real device, so
+ * the echo server has to sit behind a NIC or a veth pair, e.g. in another
+ * network namespace:
+ *
+ *      ip netns add peer
+ *      ip link add veth0 type veth peer name veth1 netns peer
+ *      ip addr add 10.0.0.1/24 dev veth0 && ip link set veth0 up
+ *      ip -n peer addr add 10.0.0.2/24 dev veth1
+ *      ip -n peer link set veth1 up
+ *      ip netns exec peer ./bench_napi server 10.0.0.2 7777 &
+ *      ./bench_napi 10.0.0.2 7777
+ *
+ * Without arguments it falls back to an in-process server on loopback,
+ * which has no NAPI id to poll, so both runs should come out about even
+ * there; the output is labelled accordingly.
+ *
+ *      ./bench_napi
+ */
+int main(const int argc, char* argv[]) {
+  try {
+    if (argc == 4 && std::string_view{argv[1]} == "server") {
+      sockaddr_in addr = parse_addr(argv[2], argv[3]);
+      const int listen_fd = listen_on(addr);
+      echo(listen_fd, 2);
+      ::close(listen_fd);
+      return 0;
+    }
+
+    if (argc == 3) {
+      const sockaddr_in peer = parse_addr(argv[1], argv[2]);
+      run("interrupt", false, peer);
+      run("napi busy poll", true, peer);
+      return 0;
+    }
+
+    if (argc != 1) {
+      fprintf(stderr, "%s [server] [ip port]\n", argv[0]);
+      return EXIT_FAILURE;
+    }
+
+    sockaddr_in peer{};
+    peer.sin_family = AF_INET;
+    peer.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    const int listen_fd = listen_on(peer);
+    std::thread server{echo, listen_fd, 2};
+
+    printf("loopback fallback, no NAPI id to poll\n");
+    run("interrupt", false, peer);
+    run("napi busy poll", true, peer);
+
+    server.join();
+    ::close(listen_fd);
+  } catch (const std::system_error& e) {
+    std::cerr << e.what() << "\n" << e.code() << "\n";
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << '\n';
+  }
+
+  return 0;
+}
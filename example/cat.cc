@@ -6,10 +6,12 @@
 #include <iostream>
 #include <memory>
 
+#include "uring/coalescer.h"
 #include "uring/uring.h"
 
 constexpr std::size_t kQueueDepth = 2;
 constexpr std::size_t kBatchSize = 64 * 1024;
+constexpr unsigned kSubmitBatch = 8;
 
 struct io_data {
   explicit io_data(const std::size_t size, const off_t off = 0)
@@ -34,6 +36,7 @@ static void cat_splice(liburing::uring<uring_flags>& ring, const int in_fd,
                        const struct stat& in_st, const int out_fd,
                        const struct stat& out_st) {
   (void)out_st;
+  liburing::coalescer co{ring, kSubmitBatch};
 
   off_t remaining = in_st.st_size, off = 0;
   int pipe_size = fcntl(out_fd, F_GETPIPE_SZ);
@@ -45,18 +48,18 @@ static void cat_splice(liburing::uring<uring_flags>& ring, const int in_fd,
     off_t to_read = std::min(remaining, static_cast<off_t>(pipe_size));
 
     {
-      liburing::sqe* sqe = ring.get_sqe();
+      liburing::sqe* sqe = co.get_sqe();
       if (!sqe) {
         throw std::system_error{-1, std::system_category(), "get_sqe"};
       }
       sqe->prep_splice(in_fd, off, out_fd, -1, to_read, 0);
 
-      ring.submit();
+      co.submit();
     }
 
     {
       const liburing::cqe* cqe;
-      int ret = ring.wait_cqe(cqe);
+      int ret = co.wait_cqe(cqe);
       if (ret < 0) {
         throw std::system_error{-ret, std::system_category(), "wait cqe"};
       }
@@ -77,6 +80,7 @@ static void cat_fallback(liburing::uring<uring_flags>& ring, const int in_fd,
                          const struct stat& in_st, const int out_fd,
                          const struct stat& out_st) {
   (void)out_st;
+  liburing::coalescer co{ring, kSubmitBatch};
   io_data data(kBatchSize);
   off_t remaining = in_st.st_size, off = 0;
 
@@ -86,7 +90,7 @@ static void cat_fallback(liburing::uring<uring_flags>& ring, const int in_fd,
     data.iov.iov_len = to_read;
 
     {
-      liburing::sqe* sqe = ring.get_sqe();
+      liburing::sqe* sqe = co.get_sqe();
       if (!sqe) {
         throw std::system_error{-1, std::system_category(), "get_sqe"};
       }
@@ -94,20 +98,20 @@ static void cat_fallback(liburing::uring<uring_flags>& ring, const int in_fd,
       sqe->flags |= IOSQE_IO_LINK;
       sqe->set_data(&data);
 
-      sqe = ring.get_sqe();
+      sqe = co.get_sqe();
       if (!sqe) {
         throw std::system_error{-1, std::system_category(), "get_sqe"};
       }
       sqe->prep_writev(out_fd, std::span{&data.iov, 1}, -1);
       sqe->set_data(&data);
 
-      ring.submit();
+      co.submit();
       inflight += 2;
     }
 
     while (inflight > 0) {
       const liburing::cqe* cqe;
-      int ret = ring.wait_cqe(cqe);
+      int ret = co.wait_cqe(cqe);
       if (ret < 0) {
         throw std::system_error{-ret, std::system_category(), "wait cqe"};
       }
@@ -6,6 +6,7 @@
 #include <iostream>
 #include <memory>
 
+#include "uring/chain.h"
 #include "uring/uring.h"
 
 constexpr std::size_t kQueueDepth = 64;
@@ -75,23 +76,17 @@ static off_t file_size(const int fd) {
 template <unsigned uring_flags>
 static void rw_pair(liburing::uring<uring_flags>& ring, std::size_t size,
                     const off_t off, const int in_fd, const int out_fd) {
-  auto data = new io_data(event_type::NOP, size, off);
-  liburing::sqe* sqe = nullptr;
-
-  sqe = ring.get_sqe();
-  if (!sqe) {
-    throw std::system_error{-1, std::system_category(), "get_sqe"};
+  liburing::chain link{ring, 2};
+  if (!link) {
+    throw std::system_error{EBUSY, std::system_category(), "chain"};
   }
-  sqe->prep_readv(in_fd, std::span{&data->iov, 1}, off);
-  sqe->flags |= IOSQE_IO_LINK;
-  sqe->set_data(data);
 
-  sqe = ring.get_sqe();
-  if (!sqe) {
-    throw std::system_error{-1, std::system_category(), "get_sqe"};
-  }
-  sqe->prep_writev(out_fd, std::span{&data->iov, 1}, off);
-  sqe->set_data(data);
+  auto data = new io_data(event_type::NOP, size, off);
+  link[0].prep_readv(in_fd, std::span{&data->iov, 1}, off);
+  link[0].set_data(data);
+  link[1].prep_writev(out_fd, std::span{&data->iov, 1}, off);
+  link[1].set_data(data);
+  link.commit();
 }
 
 template <unsigned uring_flags>
@@ -4,6 +4,8 @@
 #define LIBURING_ARCH_GENERIC_SYSCALL_H
 
 #include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 
 static inline int __sys_io_uring_register(unsigned int fd, unsigned int opcode,
 					  const void *arg, unsigned int nr_args)
@@ -97,4 +99,19 @@ static inline int __sys_close(int fd)
 	return (ret < 0) ? -errno : ret;
 }
 
+static inline int __sys_eventfd2(unsigned int count, int flags)
+{
+	int ret;
+	ret = eventfd(count, flags);
+	return (ret < 0) ? -errno : ret;
+}
+
+static inline int __sys_epoll_ctl(int epfd, int op, int fd,
+				  struct epoll_event *event)
+{
+	int ret;
+	ret = epoll_ctl(epfd, op, fd, event);
+	return (ret < 0) ? -errno : ret;
+}
+
 #endif /* #ifndef LIBURING_ARCH_GENERIC_SYSCALL_H */
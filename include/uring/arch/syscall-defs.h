@@ -5,6 +5,8 @@
 
 #include <fcntl.h>
 
+struct epoll_event;
+
 static inline int __sys_open(const char *pathname, int flags, mode_t mode)
 {
 	/*
@@ -61,6 +63,17 @@ static inline int __sys_close(int fd)
 	return (int) __do_syscall1(__NR_close, fd);
 }
 
+static inline int __sys_eventfd2(unsigned int count, int flags)
+{
+	return (int) __do_syscall2(__NR_eventfd2, count, flags);
+}
+
+static inline int __sys_epoll_ctl(int epfd, int op, int fd,
+				  struct epoll_event *event)
+{
+	return (int) __do_syscall4(__NR_epoll_ctl, epfd, op, fd, event);
+}
+
 static inline int __sys_io_uring_register(unsigned int fd, unsigned int opcode,
 					  const void *arg, unsigned int nr_args)
 {
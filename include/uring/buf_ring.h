@@ -0,0 +1,294 @@
+#ifndef URING_BUF_RING_H
+#define URING_BUF_RING_H
+
+#include <sys/mman.h>
+
+#include <bit>
+#include <cassert>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <system_error>
+
+#include "uring/barier.h"
+#include "uring/cqe.h"
+#include "uring/io_uring.h"
+#include "uring/syscall.h"
+#include "uring/uring.h"
+
+namespace liburing {
+
+/*
+ * A provided buffer ring (IORING_REGISTER_PBUF_RING). Buffers are handed to
+ * the kernel by writing them into a shared ring and bumping its tail, so
+ * replenishing costs a store instead of a PROVIDE_BUFFERS SQE. Requests
+ * pick a buffer from the group with sqe::set_buffer_select(bgid), and the
+ * chosen buffer id comes back in the CQE flags, see cqe_buffer_id().
+ *
+ * With IOU_PBUF_RING_INC in pbuf_flags, buffers are consumed incrementally:
+ * each completion only takes as many bytes as it needs, and the buffer
+ * stays with the kernel for further completions while IORING_CQE_F_BUF_MORE
+ * is set. consume() tracks the offset into each buffer, so a few large
+ * buffers can back many small receives. Buffer ids must be below entries()
+ * in that mode.
+ *
+ * With IOU_PBUF_RING_MMAP, the kernel allocates the ring memory instead of
+ * the application, which spares the page alignment requirements and keeps
+ * the ring on the node the io_uring instance was created on.
+ */
+template <unsigned uring_flags, unsigned pbuf_flags = 0>
+class buf_ring {
+  static constexpr unsigned kMaxEntries = 32768;
+
+ public:
+  explicit buf_ring() noexcept = default;
+  ~buf_ring() noexcept;
+
+  buf_ring(const buf_ring &) = delete;
+  buf_ring(buf_ring &&) = delete;
+  buf_ring &operator=(const buf_ring &) = delete;
+  buf_ring &operator=(buf_ring &&) = delete;
+
+  [[gnu::cold]] void init(uring<uring_flags> &ring, unsigned entries,
+                          uint16_t bgid);
+
+  [[nodiscard]] uint16_t bgid() const noexcept { return bgid_; }
+  [[nodiscard]] unsigned entries() const noexcept { return mask_ + 1; }
+
+  void add(void *addr, unsigned len, uint16_t bid) noexcept;
+  void advance() noexcept;
+
+  void provide(std::span<char> buffers, unsigned buf_size) noexcept;
+  [[nodiscard]] std::span<char> buffer(uint16_t bid) const noexcept;
+  [[nodiscard]] std::span<char> consume(const cqe *cqe) noexcept;
+  void recycle(uint16_t bid) noexcept;
+  void recycle(std::span<const uint16_t> bids) noexcept;
+
+ private:
+  [[gnu::cold]] void *_map_user_ring(uring<uring_flags> &ring,
+                                     unsigned entries, uint16_t bgid);
+  [[gnu::cold]] void *_map_kernel_ring(uring<uring_flags> &ring,
+                                       unsigned entries, uint16_t bgid);
+
+  uring<uring_flags> *ring_ = nullptr;
+  io_uring_buf_ring *br_ = nullptr;
+  std::size_t ring_sz_{};
+
+  char *base_ = nullptr;
+  unsigned buf_size_{};
+  std::unique_ptr<unsigned[]> offsets_;
+
+  uint16_t tail_{};
+  uint16_t pending_{};
+  uint16_t mask_{};
+  uint16_t bgid_{};
+};
+
+template <unsigned uring_flags, unsigned pbuf_flags>
+buf_ring<uring_flags, pbuf_flags>::~buf_ring() noexcept {
+  if (!br_) {
+    return;
+  }
+
+  ring_->unregister_buf_ring(bgid_);
+  __sys_munmap(br_, ring_sz_);
+}
+
+template <unsigned uring_flags, unsigned pbuf_flags>
+void buf_ring<uring_flags, pbuf_flags>::init(uring<uring_flags> &ring,
+                                             const unsigned entries,
+                                             const uint16_t bgid) {
+  assert(!br_ && "Do not reinit buf_ring");
+
+  if (!entries || entries > kMaxEntries || !std::has_single_bit(entries))
+      [[unlikely]] {
+    throw std::system_error{EINVAL, std::system_category(),
+                            "buf_ring::init, entries must be a power of 2"};
+  }
+
+  ring_sz_ = entries * sizeof(io_uring_buf);
+  if constexpr (pbuf_flags & IOU_PBUF_RING_INC) {
+    offsets_ = std::make_unique<unsigned[]>(entries);
+  }
+
+  void *ptr;
+  if constexpr (pbuf_flags & IOU_PBUF_RING_MMAP) {
+    ptr = _map_kernel_ring(ring, entries, bgid);
+  } else {
+    ptr = _map_user_ring(ring, entries, bgid);
+  }
+
+  ring_ = &ring;
+  br_ = static_cast<io_uring_buf_ring *>(ptr);
+  br_->tail = 0;
+  tail_ = 0;
+  mask_ = static_cast<uint16_t>(entries - 1);
+  bgid_ = bgid;
+}
+
+/*
+ * The application owns the ring memory: map it anonymously and hand its
+ * address to the kernel.
+ */
+template <unsigned uring_flags, unsigned pbuf_flags>
+void *buf_ring<uring_flags, pbuf_flags>::_map_user_ring(
+    uring<uring_flags> &ring, const unsigned entries, const uint16_t bgid) {
+  void *ptr = __sys_mmap(nullptr, ring_sz_, PROT_READ | PROT_WRITE,
+                         MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+  if (IS_ERR(ptr)) [[unlikely]] {
+    throw std::system_error{-PTR_ERR(ptr), std::system_category(),
+                            "buf_ring::init, mmap"};
+  }
+
+  io_uring_buf_reg reg{
+      .ring_addr = reinterpret_cast<uintptr_t>(ptr),
+      .ring_entries = entries,
+      .bgid = bgid,
+  };
+  if (const int ret = ring.register_buf_ring(reg, pbuf_flags); ret)
+      [[unlikely]] {
+    __sys_munmap(ptr, ring_sz_);
+    throw std::system_error{-ret, std::system_category(),
+                            "buf_ring::init, register_buf_ring"};
+  }
+  return ptr;
+}
+
+/*
+ * IOU_PBUF_RING_MMAP: the kernel allocates the ring when it is registered,
+ * and it is mapped through the ring fd at an offset derived from the group
+ * id, the same way uring::mmap() maps the SQ and CQ rings. This needs a
+ * real ring fd, so it can't be used with IORING_SETUP_REGISTERED_FD_ONLY.
+ */
+template <unsigned uring_flags, unsigned pbuf_flags>
+void *buf_ring<uring_flags, pbuf_flags>::_map_kernel_ring(
+    uring<uring_flags> &ring, const unsigned entries, const uint16_t bgid) {
+  if (ring.fd() == -1) [[unlikely]] {
+    throw std::system_error{EINVAL, std::system_category(),
+                            "buf_ring::init, IOU_PBUF_RING_MMAP needs ring fd"};
+  }
+
+  io_uring_buf_reg reg{
+      .ring_entries = entries,
+      .bgid = bgid,
+  };
+  if (const int ret = ring.register_buf_ring(reg, pbuf_flags); ret)
+      [[unlikely]] {
+    throw std::system_error{-ret, std::system_category(),
+                            "buf_ring::init, register_buf_ring"};
+  }
+
+  const off_t off = static_cast<off_t>(
+      IORING_OFF_PBUF_RING |
+      (static_cast<uint64_t>(bgid) << IORING_OFF_PBUF_SHIFT));
+  void *ptr = __sys_mmap(nullptr, ring_sz_, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, ring.fd(), off);
+  if (IS_ERR(ptr)) [[unlikely]] {
+    ring.unregister_buf_ring(bgid);
+    throw std::system_error{-PTR_ERR(ptr), std::system_category(),
+                            "buf_ring::init, mmap IORING_OFF_PBUF_RING"};
+  }
+  return ptr;
+}
+
+/*
+ * Queue a buffer behind the ones already added. It isn't visible to the
+ * kernel until advance() is called, so a batch can be published at once.
+ */
+template <unsigned uring_flags, unsigned pbuf_flags>
+void buf_ring<uring_flags, pbuf_flags>::add(void *addr, const unsigned len,
+                                            const uint16_t bid) noexcept {
+  io_uring_buf *buf = &br_->bufs[(tail_ + pending_) & mask_];
+  buf->addr = reinterpret_cast<uintptr_t>(addr);
+  buf->len = len;
+  buf->bid = bid;
+  ++pending_;
+}
+
+template <unsigned uring_flags, unsigned pbuf_flags>
+void buf_ring<uring_flags, pbuf_flags>::advance() noexcept {
+  if (pending_) [[likely]] {
+    tail_ += pending_;
+    pending_ = 0;
+    io_uring_smp_store_release(&br_->tail, tail_);
+  }
+}
+
+/*
+ * Split buffers into chunks of buf_size bytes and hand them all to the
+ * kernel, chunk i with buffer id i. The ids can then be turned back into
+ * memory with buffer() and given back with recycle().
+ */
+template <unsigned uring_flags, unsigned pbuf_flags>
+void buf_ring<uring_flags, pbuf_flags>::provide(
+    const std::span<char> buffers, const unsigned buf_size) noexcept {
+  assert(buf_size && "buf_size must not be 0");
+
+  base_ = buffers.data();
+  buf_size_ = buf_size;
+
+  const std::size_t nr = std::min<std::size_t>(buffers.size() / buf_size,
+                                               entries());
+  for (std::size_t bid = 0; bid < nr; ++bid) {
+    add(base_ + bid * buf_size, buf_size, static_cast<uint16_t>(bid));
+  }
+  advance();
+}
+
+template <unsigned uring_flags, unsigned pbuf_flags>
+std::span<char> buf_ring<uring_flags, pbuf_flags>::buffer(
+    const uint16_t bid) const noexcept {
+  assert(base_ && "buffers not provided");
+  return {base_ + static_cast<std::size_t>(bid) * buf_size_, buf_size_};
+}
+
+/*
+ * The bytes a completion placed into its selected buffer. For incremental
+ * rings this is the slice following whatever earlier completions on the
+ * same buffer consumed. Once a completion arrives without
+ * IORING_CQE_F_BUF_MORE, the buffer is back with the application.
+ */
+template <unsigned uring_flags, unsigned pbuf_flags>
+std::span<char> buf_ring<uring_flags, pbuf_flags>::consume(
+    const cqe *cqe) noexcept {
+  if (!cqe_has_buffer(cqe) || cqe->res <= 0) {
+    return {};
+  }
+
+  const uint16_t bid = cqe_buffer_id(cqe);
+  if constexpr (pbuf_flags & IOU_PBUF_RING_INC) {
+    assert(bid <= mask_ && "buffer id out of range");
+
+    const unsigned off = offsets_[bid];
+    offsets_[bid] = cqe_has_buf_more(cqe) ? off + cqe->res : 0;
+    return buffer(bid).subspan(off, cqe->res);
+  }
+  return buffer(bid).first(cqe->res);
+}
+
+/*
+ * Give a consumed buffer back. Like add(), this only queues it: the kernel
+ * does not see it before the next advance(), so a loop recycling buffers
+ * one at a time can publish them all with a single advance() at the end.
+ * The span overload recycles the whole batch and advances by itself.
+ */
+template <unsigned uring_flags, unsigned pbuf_flags>
+void buf_ring<uring_flags, pbuf_flags>::recycle(const uint16_t bid) noexcept {
+  if constexpr (pbuf_flags & IOU_PBUF_RING_INC) {
+    offsets_[bid] = 0;
+  }
+  add(buffer(bid).data(), buf_size_, bid);
+}
+
+template <unsigned uring_flags, unsigned pbuf_flags>
+void buf_ring<uring_flags, pbuf_flags>::recycle(
+    const std::span<const uint16_t> bids) noexcept {
+  for (const uint16_t bid : bids) {
+    recycle(bid);
+  }
+  advance();
+}
+
+}  // namespace liburing
+
+#endif  // URING_BUF_RING_H
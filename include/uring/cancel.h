@@ -0,0 +1,67 @@
+#ifndef URING_CANCEL_H
+#define URING_CANCEL_H
+
+#include <cstdint>
+
+#include "uring/io_uring.h"
+
+namespace liburing {
+
+/*
+ * Which in-flight requests uring::cancel_sync() should cancel. Keys can be
+ * combined, e.g. by_fd(fd).with_op(IORING_OP_RECV) only matches receives
+ * on fd, and all() extends the match from the first request found to
+ * every request that matches.
+ */
+struct cancel_match {
+  uint64_t user_data{};
+  int fd = -1;
+  unsigned flags{};
+  uint8_t opcode{};
+
+  [[nodiscard]] static constexpr cancel_match by_user_data(
+      const uint64_t user_data) noexcept {
+    return {.user_data = user_data, .flags = IORING_ASYNC_CANCEL_USERDATA};
+  }
+
+  /*
+   * With fixed set, fd is an index into the registered file table.
+   */
+  [[nodiscard]] static constexpr cancel_match by_fd(
+      const int fd, const bool fixed = false) noexcept {
+    return {.fd = fd,
+            .flags = IORING_ASYNC_CANCEL_FD |
+                     (fixed ? IORING_ASYNC_CANCEL_FD_FIXED : 0)};
+  }
+
+  [[nodiscard]] static constexpr cancel_match by_op(
+      const uint8_t opcode) noexcept {
+    return {.flags = IORING_ASYNC_CANCEL_OP, .opcode = opcode};
+  }
+
+  [[nodiscard]] static constexpr cancel_match any() noexcept {
+    return {.flags = IORING_ASYNC_CANCEL_ANY};
+  }
+
+  [[nodiscard]] constexpr cancel_match with_op(
+      const uint8_t op) const noexcept {
+    cancel_match m = *this;
+    m.flags |= IORING_ASYNC_CANCEL_OP;
+    m.opcode = op;
+    return m;
+  }
+
+  [[nodiscard]] constexpr cancel_match all() const noexcept {
+    cancel_match m = *this;
+    m.flags |= IORING_ASYNC_CANCEL_ALL;
+    return m;
+  }
+
+  // clang-format off
+  [[nodiscard]] constexpr bool matches_many() const noexcept { return flags & (IORING_ASYNC_CANCEL_ALL | IORING_ASYNC_CANCEL_ANY); }
+  // clang-format on
+};
+
+}  // namespace liburing
+
+#endif  // URING_CANCEL_H
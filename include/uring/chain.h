@@ -0,0 +1,134 @@
+#ifndef URING_CHAIN_H
+#define URING_CHAIN_H
+
+#include <cassert>
+
+#include "uring/io_uring.h"
+#include "uring/sqe.h"
+#include "uring/uring.h"
+
+namespace liburing {
+
+/*
+ * Builds a chain of linked requests. All SQEs of the chain are reserved up
+ * front, so it either fits into the SQ as a whole or not at all; a failed
+ * reservation leaves the SQ as it was. The requests are prepared through
+ * operator[], and commit() then links each one to the next with link_flag
+ * (IOSQE_IO_LINK or IOSQE_IO_HARDLINK). With ts set, an
+ * IORING_OP_LINK_TIMEOUT is appended that cancels the last request if it
+ * takes longer than ts; its user_data is 0 unless set via link_timeout().
+ *
+ * ts is only read when the chain is submitted, not by commit(), so it has
+ * to stay alive until the SQEs have been submitted.
+ *
+ * A chain that goes out of scope without commit() hands its SQEs back if
+ * it is still the most recent reservation. If other SQEs have been
+ * reserved since, its SQEs are turned into NOPs instead, which complete
+ * without posting a CQE. A chain must not be submitted before it is
+ * committed.
+ *
+ *      liburing::chain link{ring, 2};
+ *      if (!link) { ... }
+ *      link[0].prep_read(...);
+ *      link[1].prep_write(...);
+ *      link.commit();
+ */
+template <unsigned uring_flags>
+class chain {
+ public:
+  explicit chain(uring<uring_flags> &ring, unsigned nr,
+                 unsigned link_flag = IOSQE_IO_LINK,
+                 __kernel_timespec *ts = nullptr,
+                 unsigned ts_flags = 0) noexcept;
+  ~chain() noexcept;
+
+  chain(const chain &) = delete;
+  chain(chain &&) = delete;
+  chain &operator=(const chain &) = delete;
+  chain &operator=(chain &&) = delete;
+
+  // clang-format off
+  [[nodiscard]] explicit operator bool() const noexcept { return reserved_; }
+  [[nodiscard]] unsigned size() const noexcept { return nr_; }
+  [[nodiscard]] sqe &operator[](const unsigned i) noexcept { assert(i < nr_); return ring_.sq_.at(head_ + i); }
+  [[nodiscard]] sqe &link_timeout() noexcept { assert(ts_); return ring_.sq_.at(head_ + nr_); }
+  // clang-format on
+
+  void commit() noexcept;
+
+ private:
+  [[nodiscard]] unsigned reserved_nr() const noexcept { return nr_ + !!ts_; }
+
+  uring<uring_flags> &ring_;
+  __kernel_timespec *ts_;
+  unsigned head_;
+  unsigned nr_;
+  unsigned link_flag_;
+  unsigned ts_flags_;
+  bool reserved_ = false;
+  bool committed_ = false;
+};
+
+template <unsigned uring_flags>
+chain<uring_flags>::chain(uring<uring_flags> &ring, const unsigned nr,
+                          const unsigned link_flag, __kernel_timespec *ts,
+                          const unsigned ts_flags) noexcept
+    : ring_(ring),
+      ts_(ts),
+      head_(ring.sq_.sqe_tail_),
+      nr_(nr),
+      link_flag_(link_flag),
+      ts_flags_(ts_flags) {
+  assert(nr && "chain must not be empty");
+
+  if (!ring_.sq_.has_room(head_, reserved_nr())) [[unlikely]] {
+    return;
+  }
+  ring_.sq_.sqe_tail_ = head_ + reserved_nr();
+  if (ts_) {
+    link_timeout().set_data(uint64_t{0});
+  }
+  reserved_ = true;
+}
+
+template <unsigned uring_flags>
+chain<uring_flags>::~chain() noexcept {
+  if (!reserved_ || committed_) {
+    return;
+  }
+
+  auto &sq = ring_.sq_;
+  if (static_cast<int>(sq.sqe_head_ - head_) > 0) [[unlikely]] {
+    assert(false && "chain was submitted before it was committed");
+    return;
+  }
+  if (sq.sqe_tail_ == head_ + reserved_nr()) [[likely]] {
+    sq.sqe_tail_ = head_;
+    return;
+  }
+
+  for (unsigned i = 0; i < reserved_nr(); ++i) {
+    sqe &sqe = sq.at(head_ + i);
+    sqe.prep_nop();
+    sqe.set_data(uint64_t{0});
+    sqe.set_ceq_skip();
+  }
+}
+
+template <unsigned uring_flags>
+void chain<uring_flags>::commit() noexcept {
+  assert(reserved_ && !committed_);
+
+  for (unsigned i = 0; i + 1 < nr_; ++i) {
+    (*this)[i].flags |= link_flag_;
+  }
+  if (ts_) {
+    (*this)[nr_ - 1].flags |= IOSQE_IO_LINK;
+    link_timeout().prep_link_timeout(ts_, ts_flags_);
+  }
+  committed_ = true;
+}
+
+}  // namespace liburing
+
+#endif  // URING_CHAIN_H
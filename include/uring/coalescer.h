@@ -0,0 +1,197 @@
+#ifndef URING_COALESCER_H
+#define URING_COALESCER_H
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cassert>
+#include <cerrno>
+#include <cstdint>
+#include <limits>
+
+#include "uring/cqe.h"
+#include "uring/sqe.h"
+#include "uring/uring.h"
+
+namespace liburing {
+
+/*
+ * Sizes of the batches a coalescer handed to the kernel. batch_log2[i]
+ * counts the flushes that submitted [2^i, 2^(i+1)) SQEs.
+ */
+struct coalescer_stats {
+  uint64_t flushes{};
+  uint64_t sqes{};
+  unsigned min_batch = std::numeric_limits<unsigned>::max();
+  unsigned max_batch{};
+  std::array<uint64_t, 16> batch_log2{};
+};
+
+/*
+ * Defers submission so that SQEs prepared one at a time still reach the
+ * kernel in batches. submit() only enters the kernel once threshold SQEs
+ * have been prepared since the last flush; the rest go out at end_tick(),
+ * or together with the next wait, which submits and waits in the same
+ * io_uring_enter(). Those flush everything the kernel has not consumed
+ * yet, pending(), including what a partial submit left behind. Call sites
+ * that did ring.submit() after every prep can call submit() on the
+ * coalescer instead and keep their structure.
+ *
+ *      liburing::coalescer co{ring, 32};
+ *      for (...) {
+ *        co.get_sqe()->prep_...(...);
+ *        co.submit();
+ *      }
+ *      co.wait_cqe(cqe);
+ */
+template <unsigned uring_flags>
+class coalescer {
+ public:
+  explicit coalescer(uring<uring_flags> &ring, unsigned threshold) noexcept;
+  ~coalescer() noexcept = default;
+
+  coalescer(const coalescer &) = delete;
+  coalescer(coalescer &&) = delete;
+  coalescer &operator=(const coalescer &) = delete;
+  coalescer &operator=(coalescer &&) = delete;
+
+  // clang-format off
+  [[nodiscard]] unsigned pending() const noexcept { return ring_.sq_ready(); }
+  [[nodiscard]] unsigned threshold() const noexcept { return threshold_; }
+  [[nodiscard]] const coalescer_stats &stats() const noexcept { return stats_; }
+  void reset_stats() noexcept { stats_ = {}; }
+  int submit() noexcept { return _unpublished() >= threshold_ ? flush() : 0; }
+  int end_tick() noexcept { return flush(); }
+  // clang-format on
+
+  [[nodiscard]] sqe *get_sqe() noexcept;
+  int flush() noexcept;
+
+  int submit_and_wait(unsigned wait_nr) noexcept;
+  int wait_cqe(const cqe *(&cqe_ptr)) noexcept;
+  int wait_cqe_nr(const cqe *(&cqe_ptr), unsigned wait_nr) noexcept;
+  int wait_cqes(const cqe *(&cqe_ptr), unsigned wait_nr, __kernel_timespec *ts,
+                sigset_t *sigmask) noexcept;
+
+ private:
+  // clang-format off
+  [[nodiscard]] unsigned _unpublished() const noexcept { return ring_.sq_.sqe_tail_ - ring_.sq_.sqe_head_; }
+  // clang-format on
+  void _record(unsigned nr) noexcept;
+
+  uring<uring_flags> &ring_;
+  unsigned threshold_;
+  coalescer_stats stats_;
+};
+
+template <unsigned uring_flags>
+coalescer<uring_flags>::coalescer(uring<uring_flags> &ring,
+                                  const unsigned threshold) noexcept
+    : ring_(ring), threshold_(threshold) {
+  assert(threshold && "threshold must not be 0");
+}
+
+/*
+ * Like uring::get_sqe(), but when the SQ is full the pending batch is
+ * flushed to make room. With SQPOLL the SQ can also be full of entries that
+ * are published but not yet consumed, in which case this waits for the
+ * poller as get_sqe<sqe_policy::submit>() does.
+ */
+template <unsigned uring_flags>
+sqe *coalescer<uring_flags>::get_sqe() noexcept {
+  if (sqe *sqe = ring_.get_sqe()) [[likely]] {
+    return sqe;
+  }
+  if (flush() < 0) [[unlikely]] {
+    return nullptr;
+  }
+  return ring_.template get_sqe<sqe_policy::submit>();
+}
+
+/*
+ * Whether to enter is decided on everything the kernel has not consumed,
+ * including SQEs published by an earlier, partial submit. The stats record
+ * only what this flush publishes, though: with SQPOLL, submit() also
+ * counts SQEs an earlier flush published that the poller had not picked up
+ * yet.
+ */
+template <unsigned uring_flags>
+int coalescer<uring_flags>::flush() noexcept {
+  if (!pending()) {
+    return 0;
+  }
+
+  const unsigned nr = _unpublished();
+  const int ret = ring_.submit();
+  if (ret >= 0) {
+    _record(nr);
+  }
+  return ret;
+}
+
+/*
+ * The waits flush whatever is pending as part of the same system call, so
+ * a request is never left sitting in the SQ while its submitter sleeps on
+ * its completion.
+ */
+template <unsigned uring_flags>
+int coalescer<uring_flags>::submit_and_wait(const unsigned wait_nr) noexcept {
+  const unsigned nr = _unpublished();
+  const int ret = ring_.submit_and_wait(wait_nr);
+  if (ret >= 0) {
+    _record(nr);
+  }
+  return ret;
+}
+
+template <unsigned uring_flags>
+int coalescer<uring_flags>::wait_cqe(const cqe *(&cqe_ptr)) noexcept {
+  return wait_cqe_nr(cqe_ptr, 1);
+}
+
+template <unsigned uring_flags>
+int coalescer<uring_flags>::wait_cqe_nr(const cqe *(&cqe_ptr),
+                                        const unsigned wait_nr) noexcept {
+  if (!pending()) {
+    return ring_.wait_cqe_nr(cqe_ptr, wait_nr);
+  }
+
+  const unsigned nr = _unpublished();
+  const int ret =
+      ring_.get_cqe(cqe_ptr, ring_.sq_.flush(), wait_nr, nullptr);
+  if (ret >= 0) {
+    _record(nr);
+  }
+  return ret;
+}
+
+template <unsigned uring_flags>
+int coalescer<uring_flags>::wait_cqes(const cqe *(&cqe_ptr),
+                                      const unsigned wait_nr,
+                                      __kernel_timespec *ts,
+                                      sigset_t *sigmask) noexcept {
+  const unsigned nr = _unpublished();
+  const int ret = ring_.submit_and_wait_timeout(cqe_ptr, wait_nr, ts, sigmask);
+  if (ret >= 0 || ret == -ETIME) {
+    _record(nr);
+  }
+  return ret;
+}
+
+template <unsigned uring_flags>
+void coalescer<uring_flags>::_record(const unsigned nr) noexcept {
+  if (!nr) {
+    return;
+  }
+  ++stats_.flushes;
+  stats_.sqes += nr;
+  stats_.min_batch = std::min(stats_.min_batch, nr);
+  stats_.max_batch = std::max(stats_.max_batch, nr);
+  const unsigned bucket = std::bit_width(nr) - 1;
+  ++stats_.batch_log2[std::min<std::size_t>(bucket,
+                                            stats_.batch_log2.size() - 1)];
+}
+
+}  // namespace liburing
+
+#endif  // URING_COALESCER_H
@@ -1,6 +1,11 @@
 #ifndef URING_CQ_H
 #define URING_CQ_H
 
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <span>
+
 #include "uring/barier.h"
 #include "uring/cqe.h"
 #include "uring/params.h"
@@ -30,16 +35,35 @@ class cq {
     requires std::invocable<Fn, cqe *>
   unsigned for_each(Fn fn) noexcept(std::is_nothrow_invocable_v<Fn, cqe *>);
 
+  template <typename Fn>
+    requires std::invocable<Fn, cqe *>
+  unsigned for_each_and_advance(Fn fn) noexcept(
+      std::is_nothrow_invocable_v<Fn, cqe *>);
+
+  [[nodiscard]] unsigned ready() const noexcept;
+  unsigned peek_batch(std::span<const cqe *> cqes) noexcept;
   void advance(unsigned nr) noexcept;
 
+  [[nodiscard]] bool eventfd_enabled() const noexcept;
+  int eventfd_toggle(bool enabled) noexcept;
+
   cqe &at(unsigned offset) noexcept;
   const cqe &at(unsigned offset) const noexcept;
 
+  /*
+   * user_data of the timeout SQEs uring queues itself for timed waits on
+   * kernels without IORING_FEAT_EXT_ARG. Their completions are consumed
+   * here and never handed to the application.
+   */
+  static constexpr uint64_t LIBURING_UDATA_TIMEOUT = -1ULL;
+
   static constexpr unsigned cqe_shift_from_flags(unsigned flags) noexcept;
   static constexpr unsigned cqe_shift() noexcept;
   static constexpr std::size_t cq_size(unsigned cqes) noexcept;
 
  private:
+  [[nodiscard]] bool _is_internal(const cqe *cqe) const noexcept;
+
   unsigned *khead_ = nullptr;
   unsigned *ktail_ = nullptr;
   unsigned ring_mask_{};
@@ -50,6 +74,9 @@ class cq {
 
   std::size_t ring_sz_{};
   void *ring_ptr_ = nullptr;
+
+  // internal timeouts whose completion has not been consumed yet
+  unsigned internal_timeouts_{};
 };
 
 template <unsigned uring_flags>
@@ -75,13 +102,78 @@ unsigned cq<uring_flags>::for_each(Fn fn) noexcept(
     std::is_nothrow_invocable_v<Fn, cqe *>) {
   unsigned cnt = 0;
   for (auto head = *khead_; head != io_uring_smp_load_acquire(ktail_);
-       ++head, ++cnt) {
+       ++head) {
     cqe *cqe = &at(head);
+    if (_is_internal(cqe)) [[unlikely]] {
+      continue;
+    }
     fn(cqe);
+    ++cnt;
   }
   return cnt;
 }
 
+/*
+ * Same as for_each(), but the tail is only sampled once and the head is
+ * committed with a single store-release after the whole batch has been
+ * handed to fn, instead of one per completion.
+ */
+template <unsigned uring_flags>
+template <typename Fn>
+  requires std::invocable<Fn, cqe *>
+unsigned cq<uring_flags>::for_each_and_advance(Fn fn) noexcept(
+    std::is_nothrow_invocable_v<Fn, cqe *>) {
+  const unsigned tail = io_uring_smp_load_acquire(ktail_);
+  const unsigned head = *khead_;
+  unsigned cnt = 0;
+  for (auto i = head; i != tail; ++i) {
+    cqe *cqe = &at(i);
+    if (_is_internal(cqe)) [[unlikely]] {
+      --internal_timeouts_;
+      continue;
+    }
+    fn(cqe);
+    ++cnt;
+  }
+  advance(tail - head);
+  return cnt;
+}
+
+template <unsigned uring_flags>
+unsigned cq<uring_flags>::ready() const noexcept {
+  return io_uring_smp_load_acquire(ktail_) - *khead_;
+}
+
+/*
+ * The batch has to be contiguous from the head, as the caller retires it
+ * with advance(). An internal timeout completion at the head is consumed
+ * right away; one further in ends the batch, and is consumed by the next
+ * call once it has moved up to the head.
+ */
+template <unsigned uring_flags>
+unsigned cq<uring_flags>::peek_batch(std::span<const cqe *> cqes) noexcept {
+  while (ready() && _is_internal(&at(*khead_))) [[unlikely]] {
+    --internal_timeouts_;
+    advance(1);
+  }
+
+  const unsigned count = std::min<std::size_t>(ready(), cqes.size());
+  const unsigned head = *khead_;
+  for (unsigned i = 0; i < count; ++i) {
+    const cqe *cqe = &at(head + i);
+    if (_is_internal(cqe)) [[unlikely]] {
+      return i;
+    }
+    cqes[i] = cqe;
+  }
+  return count;
+}
+
+template <unsigned uring_flags>
+bool cq<uring_flags>::_is_internal(const cqe *cqe) const noexcept {
+  return internal_timeouts_ && cqe->user_data == LIBURING_UDATA_TIMEOUT;
+}
+
 template <unsigned uring_flags>
 void cq<uring_flags>::advance(const unsigned nr) noexcept {
   if (nr) [[likely]] {
@@ -89,6 +181,37 @@ void cq<uring_flags>::advance(const unsigned nr) noexcept {
   }
 }
 
+template <unsigned uring_flags>
+bool cq<uring_flags>::eventfd_enabled() const noexcept {
+  if (!kflags_) {
+    return true;
+  }
+  return !(IO_URING_READ_ONCE(*kflags_) & IORING_CQ_EVENTFD_DISABLED);
+}
+
+/*
+ * Stop or resume eventfd notifications for new completions. Only the
+ * application writes this flag, the kernel just reads it.
+ */
+template <unsigned uring_flags>
+int cq<uring_flags>::eventfd_toggle(const bool enabled) noexcept {
+  if (enabled == eventfd_enabled()) {
+    return 0;
+  }
+  if (!kflags_) [[unlikely]] {
+    return -EOPNOTSUPP;
+  }
+
+  unsigned flags = IO_URING_READ_ONCE(*kflags_);
+  if (enabled) {
+    flags &= ~IORING_CQ_EVENTFD_DISABLED;
+  } else {
+    flags |= IORING_CQ_EVENTFD_DISABLED;
+  }
+  IO_URING_WRITE_ONCE(*kflags_, flags);
+  return 0;
+}
+
 template <unsigned uring_flags>
 cqe &cq<uring_flags>::at(const unsigned offset) noexcept {
   return cqes_[(offset & ring_mask_) << cqe_shift()];
@@ -1,6 +1,8 @@
 #ifndef URING_CQE_H
 #define URING_CQE_H
 
+#include <cstdint>
+#include <span>
 #include <type_traits>
 
 #include "uring/io_uring.h"
@@ -14,6 +16,22 @@ static_assert(sizeof(cqe) == sizeof(io_uring_cqe));
 static_assert(sizeof(cqe) == 16);
 static_assert(alignof(cqe) == 8);
 
+// clang-format off
+[[nodiscard]] inline bool cqe_has_more(const cqe *cqe) noexcept { return cqe->flags & IORING_CQE_F_MORE; }
+[[nodiscard]] inline bool cqe_has_buffer(const cqe *cqe) noexcept { return cqe->flags & IORING_CQE_F_BUFFER; }
+[[nodiscard]] inline bool cqe_has_buf_more(const cqe *cqe) noexcept { return cqe->flags & IORING_CQE_F_BUF_MORE; }
+[[nodiscard]] inline uint16_t cqe_buffer_id(const cqe *cqe) noexcept { return cqe->flags >> IORING_CQE_BUFFER_SHIFT; }
+// clang-format on
+
+/*
+ * The two extra words of a 32 byte CQE. Only valid on a ring set up with
+ * IORING_SETUP_CQE32, where passthrough commands return extra results.
+ */
+[[nodiscard]] inline std::span<const __u64, 2> big_cqe(
+    const cqe *cqe) noexcept {
+  return std::span<const __u64, 2>{cqe->big_cqe, 2};
+}
+
 }  // namespace liburing
 
 #endif  // URING_CQE_H
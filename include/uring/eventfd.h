@@ -0,0 +1,161 @@
+#ifndef URING_EVENTFD_H
+#define URING_EVENTFD_H
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#include <cassert>
+#include <cerrno>
+#include <cstdint>
+#include <functional>
+#include <system_error>
+
+#include "uring/barier.h"
+#include "uring/cqe.h"
+#include "uring/syscall.h"
+#include "uring/uring.h"
+
+namespace liburing {
+
+/*
+ * Lets an epoll based event loop drive a ring: an eventfd registered with
+ * the ring becomes readable when completions are posted, so the loop only
+ * needs to watch fd() and call drain() when it fires, instead of polling
+ * the CQ on every iteration.
+ *
+ * While drain() is reaping, eventfd notifications are switched off through
+ * IORING_CQ_EVENTFD_DISABLED, so a burst of completions costs one wakeup
+ * rather than an eventfd write per CQE.
+ */
+template <unsigned uring_flags>
+class eventfd_bridge {
+ public:
+  explicit eventfd_bridge() noexcept = default;
+  ~eventfd_bridge() noexcept;
+
+  eventfd_bridge(const eventfd_bridge &) = delete;
+  eventfd_bridge(eventfd_bridge &&) = delete;
+  eventfd_bridge &operator=(const eventfd_bridge &) = delete;
+  eventfd_bridge &operator=(eventfd_bridge &&) = delete;
+
+  [[gnu::cold]] void init(uring<uring_flags> &ring, bool async = false);
+
+  [[nodiscard]] int fd() const noexcept { return efd_; }
+
+  int attach(int epfd, uint32_t events = EPOLLIN) noexcept;
+  int detach(int epfd) noexcept;
+
+  template <typename Fn>
+    requires std::invocable<Fn, cqe *>
+  unsigned drain(Fn &&fn) noexcept(std::is_nothrow_invocable_v<Fn, cqe *>);
+
+ private:
+  void _flush_events() noexcept;
+
+  uring<uring_flags> *ring_ = nullptr;
+  int efd_ = -1;
+};
+
+template <unsigned uring_flags>
+eventfd_bridge<uring_flags>::~eventfd_bridge() noexcept {
+  if (efd_ == -1) {
+    return;
+  }
+
+  ring_->unregister_eventfd();
+  __sys_close(efd_);
+}
+
+template <unsigned uring_flags>
+void eventfd_bridge<uring_flags>::init(uring<uring_flags> &ring,
+                                       const bool async) {
+  assert(efd_ == -1 && "Do not reinit eventfd_bridge");
+
+  const int efd = __sys_eventfd2(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (efd < 0) [[unlikely]] {
+    throw std::system_error{-efd, std::system_category(),
+                            "eventfd_bridge::init, eventfd"};
+  }
+
+  const int ret =
+      async ? ring.register_eventfd_async(efd) : ring.register_eventfd(efd);
+  if (ret) [[unlikely]] {
+    __sys_close(efd);
+    throw std::system_error{-ret, std::system_category(),
+                            "eventfd_bridge::init, register_eventfd"};
+  }
+
+  ring_ = &ring;
+  efd_ = efd;
+}
+
+/*
+ * Add the eventfd to the epoll set epfd, with this bridge as the event's
+ * data.ptr so the loop can dispatch on it.
+ */
+template <unsigned uring_flags>
+int eventfd_bridge<uring_flags>::attach(const int epfd,
+                                        const uint32_t events) noexcept {
+  epoll_event ev{
+      .events = events,
+      .data = {.ptr = this},
+  };
+  return __sys_epoll_ctl(epfd, EPOLL_CTL_ADD, efd_, &ev);
+}
+
+template <unsigned uring_flags>
+int eventfd_bridge<uring_flags>::detach(const int epfd) noexcept {
+  return __sys_epoll_ctl(epfd, EPOLL_CTL_DEL, efd_, nullptr);
+}
+
+/*
+ * Reset the eventfd and hand every pending completion to fn, with
+ * notifications off in the meantime. Once the CQ looks empty they are
+ * turned back on, and the CQ is checked once more: a completion that
+ * slipped in just before that raised no event, and would otherwise sit
+ * there until something else woke the loop up.
+ *
+ * Completions that are not in the CQ ring yet are flushed into it first.
+ * With IORING_SETUP_DEFER_TASKRUN the eventfd fires as soon as task work
+ * is queued, but the CQEs only get posted once the ring is entered, so
+ * drain() has to be called from the ring's submitter task there. The same
+ * goes for completions that overflowed the CQ.
+ */
+template <unsigned uring_flags>
+template <typename Fn>
+  requires std::invocable<Fn, cqe *>
+unsigned eventfd_bridge<uring_flags>::drain(Fn &&fn) noexcept(
+    std::is_nothrow_invocable_v<Fn, cqe *>) {
+  uint64_t cnt;
+  __sys_read(efd_, &cnt, sizeof(cnt));
+
+  unsigned reaped = 0;
+  do {
+    ring_->cq_eventfd_toggle(false);
+    while (true) {
+      _flush_events();
+      const unsigned nr = ring_->for_each_and_advance(std::ref(fn));
+      if (!nr) {
+        break;
+      }
+      reaped += nr;
+    }
+    ring_->cq_eventfd_toggle(true);
+    io_uring_smp_mb();
+    _flush_events();
+  } while (ring_->cq_ready());
+
+  return reaped;
+}
+
+template <unsigned uring_flags>
+void eventfd_bridge<uring_flags>::_flush_events() noexcept {
+  if (uring_flags & IORING_SETUP_DEFER_TASKRUN ||
+      ring_->cq_ring_needs_flush()) {
+    ring_->get_events();
+  }
+}
+
+}  // namespace liburing
+
+#endif  // URING_EVENTFD_H
@@ -11,6 +11,7 @@ enum {
   INT_FLAG_REG_REG_RING	= 1,
   INT_FLAG_APP_MEM	= 2,
   INT_FLAG_CQ_ENTER	= 4,
+  INT_FLAG_BOOTTIME	= 8,
 };
 
 #endif
\ No newline at end of file
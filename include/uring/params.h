@@ -10,6 +10,47 @@ namespace liburing {
 template <unsigned uring_flags>
 struct uring_params final : io_uring_params {
   explicit uring_params() noexcept : io_uring_params{.flags = uring_flags} {}
+
+  /*
+   * Pin the SQPOLL thread to cpu. Without IORING_SETUP_SQ_AFF the kernel
+   * lets the thread float.
+   */
+  uring_params &set_sq_thread_cpu(const unsigned cpu) noexcept
+    requires(bool(uring_flags & IORING_SETUP_SQPOLL) &&
+             bool(uring_flags & IORING_SETUP_SQ_AFF))
+  {
+    sq_thread_cpu = cpu;
+    return *this;
+  }
+
+  /*
+   * How long the SQPOLL thread keeps spinning on an empty SQ before it goes
+   * to sleep and the next submit has to wake it up. Defaults to one second.
+   */
+  uring_params &set_sq_thread_idle(const unsigned idle_ms) noexcept
+    requires(bool(uring_flags & IORING_SETUP_SQPOLL))
+  {
+    sq_thread_idle = idle_ms;
+    return *this;
+  }
+
+  /*
+   * Share the io-wq async worker pool of the ring behind wq_fd instead of
+   * creating one for this ring.
+   */
+  uring_params &set_wq_fd(const int fd) noexcept
+    requires(bool(uring_flags & IORING_SETUP_ATTACH_WQ))
+  {
+    wq_fd = static_cast<__u32>(fd);
+    return *this;
+  }
+
+  uring_params &set_cq_entries(const unsigned entries) noexcept
+    requires(bool(uring_flags & IORING_SETUP_CQSIZE))
+  {
+    cq_entries = entries;
+    return *this;
+  }
 };
 
 static_assert(std::is_standard_layout_v<uring_params<0>>);
@@ -0,0 +1,44 @@
+#ifndef URING_PROBE_H
+#define URING_PROBE_H
+
+#include <bitset>
+#include <cstdint>
+
+#include "uring/io_uring.h"
+
+namespace liburing {
+
+/*
+ * The opcodes the running kernel supports, as reported once by
+ * IORING_REGISTER_PROBE, see uring::get_probe(). Lookups are a single bit
+ * test, so the result can be consulted freely when picking between e.g.
+ * IORING_OP_READ_MULTISHOT and a plain IORING_OP_READ.
+ */
+class probe {
+ public:
+  static constexpr unsigned kMaxOps = 256;
+
+  explicit probe() noexcept = default;
+  explicit probe(const io_uring_probe *p) noexcept;
+
+  // clang-format off
+  [[nodiscard]] bool supports(const uint8_t op) const noexcept { return ops_[op]; }
+  [[nodiscard]] uint8_t last_op() const noexcept { return last_op_; }
+  // clang-format on
+
+ private:
+  std::bitset<kMaxOps> ops_;
+  uint8_t last_op_{};
+};
+
+inline probe::probe(const io_uring_probe *p) noexcept : last_op_(p->last_op) {
+  for (unsigned i = 0; i < p->ops_len; ++i) {
+    if (p->ops[i].flags & IO_URING_OP_SUPPORTED) {
+      ops_[p->ops[i].op] = true;
+    }
+  }
+}
+
+}  // namespace liburing
+
+#endif  // URING_PROBE_H
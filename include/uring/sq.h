@@ -1,6 +1,10 @@
 #ifndef URING_SQ_H
 #define URING_SQ_H
 
+#include <algorithm>
+#include <array>
+#include <span>
+
 #include "uring/barier.h"
 #include "uring/params.h"
 #include "uring/sqe.h"
@@ -12,6 +16,10 @@ class sq {
  public:
   template <unsigned>
   friend class uring;
+  template <unsigned>
+  friend class chain;
+  template <unsigned>
+  friend class coalescer;
 
   sq() noexcept = default;
   ~sq() noexcept = default;
@@ -21,14 +29,19 @@ class sq {
   [[nodiscard]] unsigned ready() const noexcept;
   [[nodiscard]] unsigned space_left() const noexcept;
   [[nodiscard]] sqe *get_sqe() noexcept;
+  [[nodiscard]] std::array<std::span<sqe>, 2> get_sqes(unsigned nr) noexcept
+    requires(!(uring_flags & IORING_SETUP_SQE128));
   unsigned flush() noexcept;
 
+  sqe &at(unsigned index) noexcept;
+
   static constexpr unsigned sqe_shift_from_flags(unsigned flags) noexcept;
   static constexpr unsigned sqe_shift() noexcept;
   static constexpr std::size_t sqes_size(unsigned sqes) noexcept;
 
  private:
   [[nodiscard]] unsigned load_sq_head() const noexcept;
+  [[nodiscard]] bool has_room(unsigned tail, unsigned nr) noexcept;
 
   unsigned *khead_ = nullptr;
   unsigned *ktail_ = nullptr;
@@ -41,6 +54,7 @@ class sq {
 
   unsigned sqe_head_{};
   unsigned sqe_tail_{};
+  unsigned khead_cache_{};
 
   std::size_t ring_sz_{};
   void *ring_ptr_ = nullptr;
@@ -75,15 +89,44 @@ unsigned sq<uring_flags>::space_left() const noexcept {
 template <unsigned uring_flags>
 sqe *sq<uring_flags>::get_sqe() noexcept {
   const unsigned tail = sqe_tail_;
-  if (tail - load_sq_head() >= ring_entries_) [[unlikely]] {
+  if (!has_room(tail, 1)) [[unlikely]] {
     return nullptr;
   }
 
-  sqe *e = &sqes_[(tail & ring_mask_) << sqe_shift()];
+  sqe *e = &at(tail);
   sqe_tail_ = tail + 1;
   return e;
 }
 
+template <unsigned uring_flags>
+sqe &sq<uring_flags>::at(const unsigned index) noexcept {
+  return sqes_[(index & ring_mask_) << sqe_shift()];
+}
+
+/*
+ * Reserve nr SQEs at once, with a single check for room. The SQ is a ring,
+ * so the reservation comes back as up to two spans: from the current tail
+ * to the end of the SQE array, and from its start for whatever wrapped
+ * around. Either all nr SQEs are reserved or none, in which case both
+ * spans are empty.
+ */
+template <unsigned uring_flags>
+std::array<std::span<sqe>, 2> sq<uring_flags>::get_sqes(
+    const unsigned nr) noexcept
+  requires(!(uring_flags & IORING_SETUP_SQE128))
+{
+  const unsigned tail = sqe_tail_;
+  if (!has_room(tail, nr)) [[unlikely]] {
+    return {};
+  }
+
+  const unsigned index = tail & ring_mask_;
+  const unsigned first = std::min(nr, ring_entries_ - index);
+  sqe_tail_ = tail + nr;
+  return {std::span<sqe>{sqes_ + index, first},
+          std::span<sqe>{sqes_, nr - first}};
+}
+
 template <unsigned uring_flags>
 unsigned sq<uring_flags>::flush() noexcept {
   const unsigned tail = sqe_tail_;
@@ -117,6 +160,23 @@ constexpr std::size_t sq<uring_flags>::sqes_size(unsigned sqes) noexcept {
   return sqes * sizeof(sqe);
 }
 
+/*
+ * The kernel head only ever moves forward, so a stale copy of it can only
+ * underestimate the free space. Check against the cached head first and
+ * only go to the shared cacheline if that says the SQ is full. tail never
+ * gets more than ring_entries_ ahead of the head, so the free space can be
+ * computed without wrapping, whatever nr is.
+ */
+template <unsigned uring_flags>
+bool sq<uring_flags>::has_room(const unsigned tail,
+                               const unsigned nr) noexcept {
+  if (nr <= ring_entries_ - (tail - khead_cache_)) [[likely]] {
+    return true;
+  }
+  khead_cache_ = load_sq_head();
+  return nr <= ring_entries_ - (tail - khead_cache_);
+}
+
 template <unsigned uring_flags>
 unsigned sq<uring_flags>::load_sq_head() const noexcept {
   if constexpr (uring_flags & IORING_SETUP_SQPOLL) {
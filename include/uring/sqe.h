@@ -5,6 +5,7 @@
 #include <sys/socket.h>
 #include <sys/stat.h>
 
+#include <cstddef>
 #include <cstdint>
 #include <span>
 #include <type_traits>
@@ -30,6 +31,10 @@ class sqe final : public io_uring_sqe {
   void set_io_hardlink() noexcept { this->flags |= IOSQE_IO_HARDLINK; }
   void set_async() noexcept { this->flags |= IOSQE_ASYNC; }
   void set_buffer_select() noexcept { this->flags |= IOSQE_BUFFER_SELECT; }
+  void set_buffer_select(const uint16_t buf_group) noexcept {
+    this->flags |= IOSQE_BUFFER_SELECT;
+    this->buf_group = buf_group;
+  }
   void set_ceq_skip() noexcept { this->flags |= IOSQE_CQE_SKIP_SUCCESS; }
 
   void prep_splice(int fd_in, int64_t off_in, int fd_out, int64_t off_out,
@@ -538,6 +543,34 @@ class sqe final : public io_uring_sqe {
                        flags);
   }
 
+  /*
+   * Passthrough command cmd_op for the file behind fd, with the command's
+   * payload in uring::cmd_as<T>().
+   */
+  void prep_uring_cmd(int cmd_op, int fd) noexcept {
+    prep_rw(IORING_OP_URING_CMD, fd, nullptr, 0, 0);
+    this->cmd_op = cmd_op;
+  }
+
+  /*
+   * Socket command for fd, one of SOCKET_URING_OP_*. SIOCINQ and SIOCOUTQ
+   * complete with the queued byte count in cqe->res and ignore the rest.
+   * GETSOCKOPT and SETSOCKOPT take the same level, optname, optval and
+   * optlen as their syscalls; only SOL_SOCKET is supported by the kernel.
+   */
+  void prep_cmd_sock(int cmd_op, int fd, int level, int optname, void *optval,
+                     int optlen) noexcept {
+    prep_uring_cmd(cmd_op, fd);
+    this->optval = reinterpret_cast<uint64_t>(optval);
+    this->optname = optname;
+    this->optlen = optlen;
+    this->level = level;
+  }
+
+  // bytes of command data in an SQE, and in an IORING_SETUP_SQE128 one
+  static constexpr std::size_t kCmdSize = 16;
+  static constexpr std::size_t kCmdMaxSize = kCmdSize + 64;
+
  private:
   void set_target_fixed_file(unsigned int file_index) noexcept {
     this->file_index = file_index + 1;
@@ -572,6 +605,7 @@ static_assert(std::is_standard_layout_v<sqe>);
 static_assert(sizeof(sqe) == sizeof(io_uring_sqe));
 static_assert(sizeof(sqe) == 64);
 static_assert(alignof(sqe) == 8);
+static_assert(offsetof(io_uring_sqe, cmd) + sqe::kCmdSize == sizeof(sqe));
 
 }  // namespace liburing
 
@@ -0,0 +1,111 @@
+#ifndef URING_SQE_TEMPLATE_H
+#define URING_SQE_TEMPLATE_H
+
+#if defined(__AVX__) || defined(__SSE2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include <cstdint>
+#include <cstring>
+#include <span>
+
+#include "uring/io_uring.h"
+#include "uring/sqe.h"
+
+namespace liburing {
+
+/*
+ * A prebuilt SQE for requests that only differ in addr, len, off and
+ * user_data. Everything else (opcode, fd, flags, buf_index, ...) is filled
+ * in once, possibly at compile time, and emit() copies the whole 64 bytes
+ * into the ring with a few vector stores before patching the per-request
+ * fields, instead of the field by field stores of sqe::prep_*().
+ *
+ * Only the 64 byte entry is written: on an IORING_SETUP_SQE128 ring the
+ * second half of the SQE keeps whatever the previous request left there,
+ * so templates are meant for rings with 64 byte SQEs.
+ *
+ *      static constexpr liburing::sqe_template kRead{IORING_OP_READ, fd};
+ *      kRead.emit(*ring.get_sqe(), buf, off, data);
+ */
+class sqe_template {
+ public:
+  constexpr explicit sqe_template(const uint8_t opcode, const int fd,
+                                  const uint8_t flags = 0) noexcept {
+    sqe_.opcode = opcode;
+    sqe_.fd = fd;
+    sqe_.flags = flags;
+  }
+
+  // clang-format off
+  constexpr sqe_template &set_ioprio(const uint16_t ioprio) noexcept { sqe_.ioprio = ioprio; return *this; }
+  constexpr sqe_template &set_rw_flags(const int rw_flags) noexcept { sqe_.rw_flags = rw_flags; return *this; }
+  constexpr sqe_template &set_buf_index(const uint16_t buf_index) noexcept { sqe_.buf_index = buf_index; return *this; }
+  constexpr sqe_template &set_personality(const uint16_t personality) noexcept { sqe_.personality = personality; return *this; }
+  // clang-format on
+
+  void emit(sqe &dst, uint64_t addr, unsigned len, uint64_t off,
+            uint64_t user_data) const noexcept;
+
+  void emit(sqe &dst, const std::span<char> buf, const uint64_t off,
+            const uint64_t user_data) const noexcept {
+    emit(dst, reinterpret_cast<uint64_t>(buf.data()), buf.size(), off,
+         user_data);
+  }
+
+  [[nodiscard]] constexpr const io_uring_sqe &get() const noexcept {
+    return sqe_;
+  }
+
+ private:
+  static void _copy(void *dst, const void *src) noexcept;
+
+  alignas(64) io_uring_sqe sqe_{};
+};
+
+static_assert(sizeof(sqe_template) == sizeof(io_uring_sqe));
+
+inline void sqe_template::emit(sqe &dst, const uint64_t addr,
+                               const unsigned len, const uint64_t off,
+                               const uint64_t user_data) const noexcept {
+  _copy(&dst, &sqe_);
+  dst.addr = addr;
+  dst.len = len;
+  dst.off = off;
+  dst.user_data = user_data;
+}
+
+/*
+ * SQEs in the ring are 64 byte aligned, and so is the template, but only
+ * the template is assumed to be: dst may be a copy somewhere else.
+ */
+inline void sqe_template::_copy(void *dst, const void *src) noexcept {
+#if defined(__AVX__)
+  const auto *s = static_cast<const __m256i *>(src);
+  auto *d = static_cast<__m256i *>(dst);
+  _mm256_storeu_si256(d, _mm256_load_si256(s));
+  _mm256_storeu_si256(d + 1, _mm256_load_si256(s + 1));
+#elif defined(__SSE2__)
+  const auto *s = static_cast<const __m128i *>(src);
+  auto *d = static_cast<__m128i *>(dst);
+  _mm_storeu_si128(d, _mm_load_si128(s));
+  _mm_storeu_si128(d + 1, _mm_load_si128(s + 1));
+  _mm_storeu_si128(d + 2, _mm_load_si128(s + 2));
+  _mm_storeu_si128(d + 3, _mm_load_si128(s + 3));
+#elif defined(__ARM_NEON)
+  const auto *s = static_cast<const uint8_t *>(src);
+  auto *d = static_cast<uint8_t *>(dst);
+  vst1q_u8(d, vld1q_u8(s));
+  vst1q_u8(d + 16, vld1q_u8(s + 16));
+  vst1q_u8(d + 32, vld1q_u8(s + 32));
+  vst1q_u8(d + 48, vld1q_u8(s + 48));
+#else
+  std::memcpy(dst, src, sizeof(io_uring_sqe));
+#endif
+}
+
+}  // namespace liburing
+
+#endif  // URING_SQE_TEMPLATE_H
@@ -1,30 +1,65 @@
 #ifndef URING_URING_H
 #define URING_URING_H
 
+#include <sched.h>
 #include <sys/mman.h>
+#include <sys/uio.h>
 
+#include <array>
+#include <bit>
 #include <cassert>
 #include <cstdint>
 #include <cstring>
+#include <functional>
+#include <span>
 #include <system_error>
+#include <type_traits>
 
+#include "uring/cancel.h"
 #include "uring/cq.h"
 #include "uring/int_flags.h"
 #include "uring/io_uring.h"
 #include "uring/lib.h"
 #include "uring/params.h"
+#include "uring/probe.h"
 #include "uring/sq.h"
 #include "uring/syscall.h"
 
 namespace liburing {
 
+/*
+ * SQPOLL accounting: submits counts the submissions that found new SQEs,
+ * wakeups the ones that found the poller asleep and had to enter the
+ * kernel with IORING_ENTER_SQ_WAKEUP. A high ratio means sq_thread_idle is
+ * too short for the submission rate.
+ */
+struct sqpoll_stats {
+  uint64_t submits{};
+  uint64_t wakeups{};
+};
+
+/*
+ * What uring::get_sqe<policy>() does when the SQ is full:
+ * fail    return nullptr, same as plain get_sqe()
+ * submit  submit what is queued to make room, and retry
+ * reap    like submit, but first hand completions to the caller's handler
+ *         when the CQ is close to overflowing, so the submission doesn't
+ *         push it over
+ */
+enum class sqe_policy : uint8_t {
+  fail,
+  submit,
+  reap,
+};
+
 template <unsigned uring_flags = 0>
 class uring {
   static constexpr std::size_t kKernelMaxEntries = 32768;
   static constexpr std::size_t kKernelMaxCqEntries = 2 * kKernelMaxEntries;
   static constexpr std::size_t kRingSize = 64;
   static constexpr std::size_t kHugePageSize = 2 * 1024 * 1024;
-  static constexpr uint64_t LIBURING_UDATA_TIMEOUT = -1ULL;
+  static constexpr uint64_t LIBURING_UDATA_TIMEOUT =
+      cq<uring_flags>::LIBURING_UDATA_TIMEOUT;
 
   struct _peek_return_type {
     const cqe *_cqe = nullptr;
@@ -33,6 +68,13 @@ class uring {
   };
 
  public:
+  template <unsigned>
+  friend class uring;
+  template <unsigned>
+  friend class chain;
+  template <unsigned>
+  friend class coalescer;
+
   explicit uring() noexcept = default;
   ~uring() noexcept;
 
@@ -47,9 +89,82 @@ class uring {
                           void *buf = nullptr, std::size_t buf_size = 0);
   [[gnu::cold]] void init(unsigned entries, uring_params<uring_flags> &&p,
                           void *buf = nullptr, std::size_t buf_size = 0);
+  template <unsigned wq_flags>
+  [[gnu::cold]] void init(unsigned entries, const uring<wq_flags> &wq)
+    requires(bool(uring_flags & IORING_SETUP_ATTACH_WQ));
 
   [[nodiscard]] int fd() const noexcept { return ring_fd_; }
 
+  int resize(unsigned sq_entries, unsigned cq_entries) noexcept
+    requires(bool(uring_flags & IORING_SETUP_DEFER_TASKRUN) &&
+             bool(uring_flags & IORING_SETUP_NO_SQARRAY) &&
+             !(uring_flags & IORING_SETUP_NO_MMAP));
+
+  // clang-format off
+  [[nodiscard]] unsigned features() const noexcept { return features_; }
+  [[nodiscard]] bool has_feature(const unsigned feature) const noexcept { return (features_ & feature) == feature; }
+  // clang-format on
+
+  [[gnu::cold]] probe get_probe();
+
+  int register_ring_fd() noexcept;
+  int unregister_ring_fd() noexcept;
+
+  int register_buffers(std::span<const iovec> iovecs) noexcept;
+  int register_buffers_tags(std::span<const iovec> iovecs,
+                            std::span<const uint64_t> tags) noexcept;
+  int register_buffers_sparse(unsigned nr) noexcept;
+  int register_buffers_update_tag(unsigned off, std::span<const iovec> iovecs,
+                                  std::span<const uint64_t> tags) noexcept;
+  int unregister_buffers() noexcept;
+  template <unsigned src_flags>
+  int clone_buffers_from(const uring<src_flags> &src, unsigned dst_off = 0,
+                         unsigned src_off = 0, unsigned nr = 0,
+                         unsigned flags = 0) noexcept;
+
+  int register_files(std::span<const int> files) noexcept;
+  int register_files_tags(std::span<const int> files,
+                          std::span<const uint64_t> tags) noexcept;
+  int register_files_sparse(unsigned nr) noexcept;
+  int register_files_update(unsigned off, std::span<const int> files) noexcept;
+  int register_files_update_tag(unsigned off, std::span<const int> files,
+                                std::span<const uint64_t> tags) noexcept;
+  int unregister_files() noexcept;
+  int register_file_alloc_range(unsigned off, unsigned len) noexcept;
+
+  int register_iowq_aff(const cpu_set_t &mask) noexcept;
+  int unregister_iowq_aff() noexcept;
+  int register_iowq_max_workers(unsigned &bounded,
+                                unsigned &unbounded) noexcept;
+
+  int register_clock(clockid_t clock) noexcept;
+
+  int cancel_sync(const cancel_match &match,
+                  const __kernel_timespec *timeout = nullptr) noexcept;
+
+  int enable_rings() noexcept
+    requires(bool(uring_flags & IORING_SETUP_R_DISABLED));
+  int register_wait_region(unsigned nr_entries) noexcept
+    requires(bool(uring_flags & IORING_SETUP_R_DISABLED));
+  // clang-format off
+  [[nodiscard]] std::span<io_uring_reg_wait> reg_wait() noexcept { return {reg_wait_, reg_wait_nr_}; }
+  // clang-format on
+
+  int register_eventfd(int fd) noexcept;
+  int register_eventfd_async(int fd) noexcept;
+  int unregister_eventfd() noexcept;
+
+  int register_napi(unsigned busy_poll_to, bool prefer_busy_poll,
+                    io_uring_napi_tracking_strategy tracking =
+                        IO_URING_NAPI_TRACKING_DYNAMIC) noexcept;
+  int napi_add_id(unsigned napi_id) noexcept;
+  int napi_del_id(unsigned napi_id) noexcept;
+  int unregister_napi() noexcept;
+
+  int register_buf_ring(io_uring_buf_reg &reg, unsigned flags) noexcept;
+  int unregister_buf_ring(uint16_t bgid) noexcept;
+  int buf_ring_head(uint16_t bgid, uint16_t &head) noexcept;
+
   // clang-format off
   int submit() noexcept { return submit_and_wait(0); }
   int submit_and_wait(const unsigned wait_nr) noexcept { return _submit(sq_.flush(), wait_nr, false); }
@@ -63,19 +178,68 @@ class uring {
   [[nodiscard]] unsigned sq_ready() const noexcept { return sq_.ready(); }
   [[nodiscard]] unsigned sq_space_left() const noexcept { return sq_.space_left(); }
   [[nodiscard]] sqe *get_sqe() noexcept { return sq_.get_sqe(); }
+  [[nodiscard]] std::array<std::span<sqe>, 2> get_sqes(const unsigned nr) noexcept requires(!(uring_flags & IORING_SETUP_SQE128)) { return sq_.get_sqes(nr); }
   // clang-format on
 
+  template <sqe_policy policy>
+    requires(policy != sqe_policy::reap)
+  [[nodiscard]] sqe *get_sqe() noexcept;
+  template <sqe_policy policy, typename Fn>
+    requires(policy == sqe_policy::reap && std::invocable<Fn, cqe *>)
+  [[nodiscard]] sqe *get_sqe(Fn &&fn) noexcept(
+      std::is_nothrow_invocable_v<Fn, cqe *>);
+
+  template <typename T>
+    requires std::is_trivially_copyable_v<T>
+  [[nodiscard]] static T *cmd_as(sqe &sqe) noexcept;
+
   int get_cqe(const cqe *(&cqe_ptr), unsigned submit, unsigned wait_nr,
               sigset_t *sigmask) noexcept;
   int wait_cqe_nr(const cqe *(&cqe_ptr), unsigned wait_nr) noexcept;
   int wait_cqe(const cqe *(&cqe_ptr)) noexcept;
+  int wait_cqes(const cqe *(&cqe_ptr), unsigned wait_nr, __kernel_timespec *ts,
+                sigset_t *sigmask) noexcept;
+  int wait_cqe_timeout(const cqe *(&cqe_ptr), __kernel_timespec *ts) noexcept;
+  int submit_and_wait_timeout(const cqe *(&cqe_ptr), unsigned wait_nr,
+                              __kernel_timespec *ts,
+                              sigset_t *sigmask) noexcept;
+  int wait_cqes_until(const cqe *(&cqe_ptr), unsigned wait_nr,
+                      __kernel_timespec *deadline, sigset_t *sigmask) noexcept;
+  int wait_cqe_until(const cqe *(&cqe_ptr),
+                     __kernel_timespec *deadline) noexcept;
+  int submit_and_wait_until(const cqe *(&cqe_ptr), unsigned wait_nr,
+                            __kernel_timespec *deadline,
+                            sigset_t *sigmask) noexcept;
+  int wait_cqes_reg(const cqe *(&cqe_ptr), unsigned wait_nr,
+                    unsigned index) noexcept;
+  int submit_and_wait_reg(const cqe *(&cqe_ptr), unsigned wait_nr,
+                          unsigned index) noexcept;
   int peek_cqe(const cqe *(&cqe_ptr)) noexcept;
+  unsigned peek_batch_cqe(std::span<const cqe *> cqes) noexcept;
   void seen_cqe(const cqe *cqe) noexcept;
 
+  // clang-format off
+  [[nodiscard]] unsigned cq_ready() const noexcept { return cq_.ready(); }
+  int get_events() noexcept { return __sys_io_uring_enter(enter_ring_fd_, 0, 0, IORING_ENTER_GETEVENTS | enter_flags(), nullptr); }
+  void cq_advance(const unsigned nr) noexcept { cq_.advance(nr); }
+  [[nodiscard]] bool cq_eventfd_enabled() const noexcept { return cq_.eventfd_enabled(); }
+  int cq_eventfd_toggle(const bool enabled) noexcept { return cq_.eventfd_toggle(enabled); }
+  // clang-format on
+
   template <typename Fn>
     requires std::invocable<Fn, cqe *>
   unsigned for_each(Fn fn) noexcept(std::is_nothrow_invocable_v<Fn, cqe *>);
 
+  template <typename Fn>
+    requires std::invocable<Fn, cqe *>
+  unsigned for_each_and_advance(Fn fn) noexcept(
+      std::is_nothrow_invocable_v<Fn, cqe *>);
+
+  // clang-format off
+  [[nodiscard]] const sqpoll_stats &get_sqpoll_stats() const noexcept { return sqpoll_stats_; }
+  void reset_sqpoll_stats() noexcept { sqpoll_stats_ = {}; }
+  // clang-format on
+
   bool sq_ring_needs_enter(unsigned submit, unsigned &flags) noexcept;
   bool cq_ring_needs_flush() noexcept;
   bool cq_ring_needs_enter() noexcept;
@@ -89,18 +253,39 @@ class uring {
   static std::pair<unsigned, unsigned> get_sq_cq_entries(
       unsigned entries, const uring_params<uring_flags> &p) noexcept;
 
+  int _register(unsigned opcode, const void *arg, unsigned nr_args) noexcept;
+  int _register_files(unsigned opcode, const void *arg, unsigned nr_args,
+                      unsigned nr_files) noexcept;
   int _submit(unsigned submitted, unsigned wait_nr, bool getevents) noexcept;
+  int _make_room() noexcept;
+  [[nodiscard]] bool _cq_near_overflow() const noexcept;
+  void _count_sqpoll(unsigned submit, unsigned flags) noexcept;
+  int _submit_timeout(unsigned wait_nr, __kernel_timespec *ts,
+                      bool abs) noexcept;
 
   _peek_return_type _peek_cqe() noexcept;
 
   template <bool has_ts>
   int _get_cqe(const cqe *(&cqe_ptr),
                typename cq<uring_flags>::get_data &data) noexcept;
+  int _wait_cqes(const cqe *(&cqe_ptr), bool submit, unsigned wait_nr,
+                 __kernel_timespec *ts, sigset_t *sigmask, bool abs) noexcept;
+  int _wait_cqes_ext_arg(const cqe *(&cqe_ptr), unsigned submit,
+                         unsigned wait_nr, __kernel_timespec *ts,
+                         sigset_t *sigmask, unsigned get_flags) noexcept;
+  int _wait_cqes_reg(const cqe *(&cqe_ptr), unsigned submit, unsigned wait_nr,
+                     unsigned index) noexcept;
 
   sq<uring_flags> sq_;
   cq<uring_flags> cq_;
   int ring_fd_ = -1;
 
+  sqpoll_stats sqpoll_stats_{};
+
+  io_uring_reg_wait *reg_wait_ = nullptr;
+  std::size_t reg_wait_nr_{};
+  std::size_t reg_wait_sz_{};
+
   unsigned features_{};
   int enter_ring_fd_{};
   uint8_t int_flags_{};
@@ -118,11 +303,14 @@ uring<uring_flags>::~uring() noexcept {
    * than at process exit time.
    */
   if (int_flags_ & INT_FLAG_REG_RING) {
-    // TODO: io_uring_unregister_ring_fd(ring);
+    unregister_ring_fd();
   }
   if (ring_fd_ != -1) {
     __sys_close(ring_fd_);
   }
+  if (reg_wait_) {
+    __sys_munmap(reg_wait_, reg_wait_sz_);
+  }
 }
 
 template <unsigned uring_flags>
@@ -207,6 +395,565 @@ void uring<uring_flags>::init(const unsigned entries,
   init(entries, p, buf, buf_size);
 }
 
+/*
+ * Set up a ring that shares the async backend of wq. With SQPOLL, this
+ * means one poller thread serves both rings instead of one each.
+ */
+template <unsigned uring_flags>
+template <unsigned wq_flags>
+void uring<uring_flags>::init(const unsigned entries, const uring<wq_flags> &wq)
+  requires(bool(uring_flags & IORING_SETUP_ATTACH_WQ))
+{
+  if (wq.fd() == -1) [[unlikely]] {
+    throw std::system_error{EINVAL, std::system_category(),
+                            "uring()::init, IORING_SETUP_ATTACH_WQ needs the "
+                            "ring fd of the ring to attach to"};
+  }
+  init(entries, uring_params<uring_flags>{}.set_wq_fd(wq.fd()));
+}
+
+/*
+ * Resize the SQ and CQ rings in place with IORING_REGISTER_RESIZE_RINGS.
+ * Queued SQEs are flushed to the kernel first, which then carries them and
+ * any pending CQEs over to the new rings, so in-flight requests survive.
+ * The kernel refuses with -EOVERFLOW if they don't fit into the new sizes.
+ *
+ * The kernel only resizes IORING_SETUP_DEFER_TASKRUN rings, and doesn't
+ * report where the SQ array of the new rings lives, hence NO_SQARRAY.
+ *
+ * Any sqe or cqe pointer obtained before the call is invalid afterwards.
+ * If the new rings can't be mapped, the ring is left unusable.
+ */
+template <unsigned uring_flags>
+int uring<uring_flags>::resize(const unsigned sq_entries,
+                               const unsigned cq_entries) noexcept
+  requires(bool(uring_flags & IORING_SETUP_DEFER_TASKRUN) &&
+           bool(uring_flags & IORING_SETUP_NO_SQARRAY) &&
+           !(uring_flags & IORING_SETUP_NO_MMAP))
+{
+  sq_.flush();
+
+  uring_params<uring_flags> p;
+  p.flags = IORING_SETUP_CQSIZE;
+  p.sq_entries = sq_entries;
+  p.cq_entries = cq_entries;
+
+  const int ret = _register(IORING_REGISTER_RESIZE_RINGS, &p, 1);
+  if (ret < 0) [[unlikely]] {
+    return ret;
+  }
+
+  const unsigned sqe_head = sq_.sqe_head_;
+  const unsigned sqe_tail = sq_.sqe_tail_;
+  __sys_munmap(sq_.sqes_, sq<uring_flags>::sqes_size(sq_.ring_entries_));
+  munmap();
+  sq_ = {};
+  cq_ = {};
+
+  p.flags = uring_flags;
+  p.features = features_;
+  try {
+    mmap(ring_fd_, p);
+  } catch (const std::system_error &e) {
+    return -e.code().value();
+  }
+
+  sq_.setup_ring_pointers(p);
+  cq_.setup_ring_pointers(p);
+  sq_.sqe_head_ = sqe_head;
+  sq_.sqe_tail_ = sqe_tail;
+  // the kernel carries the head over, the cached copy has to follow it
+  sq_.khead_cache_ = sq_.load_sq_head();
+  return 0;
+}
+
+/*
+ * Register the ring fd with the ring itself, so io_uring_enter() can look
+ * it up by index rather than doing an fdget/fdput on every call.
+ */
+template <unsigned uring_flags>
+int uring<uring_flags>::register_ring_fd() noexcept {
+  io_uring_rsrc_update up{
+      .offset = -1U,
+      .data = static_cast<uint64_t>(ring_fd_),
+  };
+
+  if (int_flags_ & INT_FLAG_REG_RING) {
+    return -EEXIST;
+  }
+
+  const int ret = _register(IORING_REGISTER_RING_FDS, &up, 1);
+  if (ret == 1) {
+    enter_ring_fd_ = static_cast<int>(up.offset);
+    int_flags_ |= INT_FLAG_REG_RING;
+    if (features_ & IORING_FEAT_REG_REG_RING) {
+      int_flags_ |= INT_FLAG_REG_REG_RING;
+    }
+  }
+  return ret;
+}
+
+template <unsigned uring_flags>
+int uring<uring_flags>::unregister_ring_fd() noexcept {
+  io_uring_rsrc_update up{
+      .offset = static_cast<uint32_t>(enter_ring_fd_),
+  };
+
+  if (!(int_flags_ & INT_FLAG_REG_RING)) {
+    return -EINVAL;
+  }
+
+  const int ret = _register(IORING_UNREGISTER_RING_FDS, &up, 1);
+  if (ret == 1) {
+    enter_ring_fd_ = ring_fd_;
+    int_flags_ &= ~(INT_FLAG_REG_RING | INT_FLAG_REG_REG_RING);
+  }
+  return ret;
+}
+
+template <unsigned uring_flags>
+int uring<uring_flags>::register_buffers(
+    const std::span<const iovec> iovecs) noexcept {
+  return _register(IORING_REGISTER_BUFFERS, iovecs.data(), iovecs.size());
+}
+
+/*
+ * Register a fixed buffer table with a tag per buffer. A non-zero tag makes
+ * the kernel post a CQE with user_data set to the tag once the buffer is no
+ * longer in use after being unregistered or replaced. tags may be empty.
+ */
+template <unsigned uring_flags>
+int uring<uring_flags>::register_buffers_tags(
+    const std::span<const iovec> iovecs,
+    const std::span<const uint64_t> tags) noexcept {
+  assert((tags.empty() || tags.size() == iovecs.size()) &&
+         "one tag per buffer");
+
+  io_uring_rsrc_register reg{
+      .nr = static_cast<uint32_t>(iovecs.size()),
+      .data = reinterpret_cast<uintptr_t>(iovecs.data()),
+      .tags = reinterpret_cast<uintptr_t>(tags.data()),
+  };
+  return _register(IORING_REGISTER_BUFFERS2, &reg, sizeof(reg));
+}
+
+/*
+ * Register a table of nr empty slots, to be filled in later with
+ * register_buffers_update_tag().
+ */
+template <unsigned uring_flags>
+int uring<uring_flags>::register_buffers_sparse(const unsigned nr) noexcept {
+  io_uring_rsrc_register reg{
+      .nr = nr,
+      .flags = IORING_RSRC_REGISTER_SPARSE,
+  };
+  return _register(IORING_REGISTER_BUFFERS2, &reg, sizeof(reg));
+}
+
+/*
+ * Replace the buffers in slots [off, off + iovecs.size()). An iovec with a
+ * null base clears its slot.
+ */
+template <unsigned uring_flags>
+int uring<uring_flags>::register_buffers_update_tag(
+    const unsigned off, const std::span<const iovec> iovecs,
+    const std::span<const uint64_t> tags) noexcept {
+  assert((tags.empty() || tags.size() == iovecs.size()) &&
+         "one tag per buffer");
+
+  io_uring_rsrc_update2 up{
+      .offset = off,
+      .data = reinterpret_cast<uintptr_t>(iovecs.data()),
+      .tags = reinterpret_cast<uintptr_t>(tags.data()),
+      .nr = static_cast<uint32_t>(iovecs.size()),
+  };
+  return _register(IORING_REGISTER_BUFFERS_UPDATE, &up, sizeof(up));
+}
+
+template <unsigned uring_flags>
+int uring<uring_flags>::unregister_buffers() noexcept {
+  return _register(IORING_UNREGISTER_BUFFERS, nullptr, 0);
+}
+
+/*
+ * Copy nr entries of src's fixed buffer table, starting at src_off, into
+ * this ring's table at dst_off. nr == 0 takes the whole table. The clones
+ * share the pinned pages and their accounting with src, so a table built
+ * once by a setup ring can be handed to every worker ring cheaply. The
+ * destination range must be empty unless IORING_REGISTER_DST_REPLACE is
+ * given in flags.
+ *
+ * src is named by its real fd, which works from any thread. Only a ring set
+ * up with IORING_SETUP_REGISTERED_FD_ONLY has none; its registered index is
+ * used instead, and that is only valid on the thread that registered it.
+ */
+template <unsigned uring_flags>
+template <unsigned src_flags>
+int uring<uring_flags>::clone_buffers_from(const uring<src_flags> &src,
+                                           const unsigned dst_off,
+                                           const unsigned src_off,
+                                           const unsigned nr,
+                                           const unsigned flags) noexcept {
+  io_uring_clone_buffers buf{
+      .src_fd = static_cast<__u32>(src.ring_fd_),
+      .flags = flags,
+      .src_off = src_off,
+      .dst_off = dst_off,
+      .nr = nr,
+  };
+  if (src.ring_fd_ == -1) {
+    buf.src_fd = static_cast<__u32>(src.enter_ring_fd_);
+    buf.flags |= IORING_REGISTER_SRC_REGISTERED;
+  }
+  return _register(IORING_REGISTER_CLONE_BUFFERS, &buf, 1);
+}
+
+template <unsigned uring_flags>
+int uring<uring_flags>::register_files(
+    const std::span<const int> files) noexcept {
+  return _register_files(IORING_REGISTER_FILES, files.data(), files.size(),
+                         files.size());
+}
+
+/*
+ * Register a fixed file table with a tag per slot, see
+ * register_buffers_tags(). -1 entries leave their slot empty.
+ */
+template <unsigned uring_flags>
+int uring<uring_flags>::register_files_tags(
+    const std::span<const int> files,
+    const std::span<const uint64_t> tags) noexcept {
+  assert((tags.empty() || tags.size() == files.size()) && "one tag per file");
+
+  io_uring_rsrc_register reg{
+      .nr = static_cast<uint32_t>(files.size()),
+      .data = reinterpret_cast<uintptr_t>(files.data()),
+      .tags = reinterpret_cast<uintptr_t>(tags.data()),
+  };
+  return _register_files(IORING_REGISTER_FILES2, &reg, sizeof(reg),
+                         files.size());
+}
+
+/*
+ * Register a table of nr empty slots, e.g. to be filled in by the
+ * *_direct() preps with IORING_FILE_INDEX_ALLOC.
+ */
+template <unsigned uring_flags>
+int uring<uring_flags>::register_files_sparse(const unsigned nr) noexcept {
+  io_uring_rsrc_register reg{
+      .nr = nr,
+      .flags = IORING_RSRC_REGISTER_SPARSE,
+  };
+  return _register_files(IORING_REGISTER_FILES2, &reg, sizeof(reg), nr);
+}
+
+template <unsigned uring_flags>
+int uring<uring_flags>::register_files_update(
+    const unsigned off, const std::span<const int> files) noexcept {
+  return register_files_update_tag(off, files, {});
+}
+
+/*
+ * Replace the files in slots [off, off + files.size()) in one call. -1
+ * clears a slot, IORING_REGISTER_FILES_SKIP leaves it untouched. Returns
+ * the number of slots updated.
+ */
+template <unsigned uring_flags>
+int uring<uring_flags>::register_files_update_tag(
+    const unsigned off, const std::span<const int> files,
+    const std::span<const uint64_t> tags) noexcept {
+  assert((tags.empty() || tags.size() == files.size()) && "one tag per file");
+
+  io_uring_rsrc_update2 up{
+      .offset = off,
+      .data = reinterpret_cast<uintptr_t>(files.data()),
+      .tags = reinterpret_cast<uintptr_t>(tags.data()),
+      .nr = static_cast<uint32_t>(files.size()),
+  };
+  return _register(IORING_REGISTER_FILES_UPDATE2, &up, sizeof(up));
+}
+
+template <unsigned uring_flags>
+int uring<uring_flags>::unregister_files() noexcept {
+  return _register(IORING_UNREGISTER_FILES, nullptr, 0);
+}
+
+/*
+ * Restrict the slots handed out for IORING_FILE_INDEX_ALLOC to
+ * [off, off + len), leaving the rest of the table for explicit indices.
+ */
+template <unsigned uring_flags>
+int uring<uring_flags>::register_file_alloc_range(const unsigned off,
+                                                  const unsigned len) noexcept {
+  io_uring_file_index_range range{
+      .off = off,
+      .len = len,
+  };
+  return _register(IORING_REGISTER_FILE_ALLOC_RANGE, &range, 0);
+}
+
+/*
+ * Restrict the io-wq workers of this ring to the CPUs in mask. Note that
+ * the workers belong to the submitting task, so the mask applies to the
+ * workers of every ring that task submits to.
+ */
+template <unsigned uring_flags>
+int uring<uring_flags>::register_iowq_aff(const cpu_set_t &mask) noexcept {
+  return _register(IORING_REGISTER_IOWQ_AFF, &mask, sizeof(mask));
+}
+
+template <unsigned uring_flags>
+int uring<uring_flags>::unregister_iowq_aff() noexcept {
+  return _register(IORING_UNREGISTER_IOWQ_AFF, nullptr, 0);
+}
+
+/*
+ * Cap the io-wq workers for bounded (regular file and block) and unbounded
+ * (sockets and the like) work. A limit of 0 leaves that one unchanged, so
+ * passing 0 for both just queries. On success, both are updated with the
+ * limits that were in place before the call.
+ */
+template <unsigned uring_flags>
+int uring<uring_flags>::register_iowq_max_workers(
+    unsigned &bounded, unsigned &unbounded) noexcept {
+  unsigned values[2] = {bounded, unbounded};
+
+  const int ret = _register(IORING_REGISTER_IOWQ_MAX_WORKERS, values, 2);
+  if (ret) [[unlikely]] {
+    return ret;
+  }
+  bounded = values[0];
+  unbounded = values[1];
+  return 0;
+}
+
+/*
+ * Have the kernel signal fd, an eventfd, whenever a completion is posted.
+ * The _async variant only signals for requests that completed out of line,
+ * not for those that finished inline at submission time.
+ */
+template <unsigned uring_flags>
+int uring<uring_flags>::register_eventfd(const int fd) noexcept {
+  return _register(IORING_REGISTER_EVENTFD, &fd, 1);
+}
+
+template <unsigned uring_flags>
+int uring<uring_flags>::register_eventfd_async(const int fd) noexcept {
+  return _register(IORING_REGISTER_EVENTFD_ASYNC, &fd, 1);
+}
+
+template <unsigned uring_flags>
+int uring<uring_flags>::unregister_eventfd() noexcept {
+  return _register(IORING_UNREGISTER_EVENTFD, nullptr, 0);
+}
+
+/*
+ * Select the clock that wait timeouts and deadlines are measured on,
+ * CLOCK_MONOTONIC or CLOCK_BOOTTIME. The latter keeps counting while the
+ * system is suspended.
+ */
+template <unsigned uring_flags>
+int uring<uring_flags>::register_clock(const clockid_t clock) noexcept {
+  io_uring_clock_register reg{
+      .clockid = static_cast<__u32>(clock),
+  };
+
+  const int ret = _register(IORING_REGISTER_CLOCK, &reg, 0);
+  if (ret) [[unlikely]] {
+    return ret;
+  }
+  if (clock == CLOCK_BOOTTIME) {
+    int_flags_ |= INT_FLAG_BOOTTIME;
+  } else {
+    int_flags_ &= ~INT_FLAG_BOOTTIME;
+  }
+  return 0;
+}
+
+/*
+ * Cancel the requests selected by match and wait until they are gone,
+ * without going through an SQE and its CQE (IORING_REGISTER_SYNC_CANCEL).
+ * A null timeout waits for as long as it takes, otherwise -ETIME is
+ * returned if the requests are still around when it expires.
+ *
+ * Returns the number of requests cancelled. A match for a single request
+ * fails with -ENOENT if there was nothing to cancel, or -EALREADY if the
+ * request was already running and couldn't be interrupted.
+ */
+template <unsigned uring_flags>
+int uring<uring_flags>::cancel_sync(
+    const cancel_match &match, const __kernel_timespec *timeout) noexcept {
+  io_uring_sync_cancel_reg reg{
+      .addr = match.user_data,
+      .fd = match.fd,
+      .flags = match.flags,
+      .timeout = timeout ? *timeout : __kernel_timespec{-1, -1},
+      .opcode = match.opcode,
+  };
+
+  const int ret = _register(IORING_REGISTER_SYNC_CANCEL, &reg, 1);
+  if (ret < 0) [[unlikely]] {
+    return ret;
+  }
+  /*
+   * The kernel counts matches only when asked for more than one, a single
+   * successful cancel comes back as 0.
+   */
+  return match.matches_many() ? ret : 1;
+}
+
+/*
+ * Start processing submissions on a ring set up with
+ * IORING_SETUP_R_DISABLED.
+ */
+template <unsigned uring_flags>
+int uring<uring_flags>::enable_rings() noexcept
+  requires(bool(uring_flags & IORING_SETUP_R_DISABLED))
+{
+  return _register(IORING_REGISTER_ENABLE_RINGS, nullptr, 0);
+}
+
+/*
+ * Register an array of at least nr_entries wait arguments, rounded up to
+ * whole pages, with the kernel (IORING_REGISTER_MEM_REGION). A timed wait
+ * then only passes the index of an entry, see wait_cqes_reg(), rather than
+ * having the kernel copy and validate an io_uring_getevents_arg and a
+ * timespec on every call.
+ *
+ * The entries are filled in through reg_wait() and can be changed between
+ * waits. Registration is only possible before enable_rings().
+ */
+template <unsigned uring_flags>
+int uring<uring_flags>::register_wait_region(const unsigned nr_entries) noexcept
+  requires(bool(uring_flags & IORING_SETUP_R_DISABLED))
+{
+  assert(!reg_wait_ && "Do not reregister the wait region");
+
+  const std::size_t page_size = get_page_size();
+  const std::size_t sz = (nr_entries * sizeof(io_uring_reg_wait) +
+                          page_size - 1) &
+                         ~(page_size - 1);
+  void *ptr = __sys_mmap(nullptr, sz, PROT_READ | PROT_WRITE,
+                         MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+  if (IS_ERR(ptr)) [[unlikely]] {
+    return PTR_ERR(ptr);
+  }
+
+  io_uring_region_desc desc{
+      .user_addr = reinterpret_cast<uintptr_t>(ptr),
+      .size = sz,
+      .flags = IORING_MEM_REGION_TYPE_USER,
+  };
+  io_uring_mem_region_reg reg{
+      .region_uptr = reinterpret_cast<uintptr_t>(&desc),
+      .flags = IORING_MEM_REGION_REG_WAIT_ARG,
+  };
+  if (const int ret = _register(IORING_REGISTER_MEM_REGION, &reg, 1); ret)
+      [[unlikely]] {
+    __sys_munmap(ptr, sz);
+    return ret;
+  }
+
+  reg_wait_ = static_cast<io_uring_reg_wait *>(ptr);
+  reg_wait_nr_ = sz / sizeof(io_uring_reg_wait);
+  reg_wait_sz_ = sz;
+  return 0;
+}
+
+/*
+ * Busy poll the NAPI contexts of the ring's sockets for up to busy_poll_to
+ * microseconds while waiting for completions, rather than sleeping until
+ * the device interrupts. With dynamic tracking, the contexts are picked up
+ * from the sockets the ring does I/O on. With static tracking, only those
+ * added through napi_add_id() are polled.
+ */
+template <unsigned uring_flags>
+int uring<uring_flags>::register_napi(
+    const unsigned busy_poll_to, const bool prefer_busy_poll,
+    const io_uring_napi_tracking_strategy tracking) noexcept {
+  io_uring_napi napi{
+      .busy_poll_to = busy_poll_to,
+      .prefer_busy_poll = prefer_busy_poll,
+      .opcode = IO_URING_NAPI_REGISTER_OP,
+      .op_param = tracking,
+  };
+  return _register(IORING_REGISTER_NAPI, &napi, 1);
+}
+
+template <unsigned uring_flags>
+int uring<uring_flags>::napi_add_id(const unsigned napi_id) noexcept {
+  io_uring_napi napi{
+      .opcode = IO_URING_NAPI_STATIC_ADD_ID,
+      .op_param = napi_id,
+  };
+  return _register(IORING_REGISTER_NAPI, &napi, 1);
+}
+
+template <unsigned uring_flags>
+int uring<uring_flags>::napi_del_id(const unsigned napi_id) noexcept {
+  io_uring_napi napi{
+      .opcode = IO_URING_NAPI_STATIC_DEL_ID,
+      .op_param = napi_id,
+  };
+  return _register(IORING_REGISTER_NAPI, &napi, 1);
+}
+
+template <unsigned uring_flags>
+int uring<uring_flags>::unregister_napi() noexcept {
+  io_uring_napi napi{};
+  return _register(IORING_UNREGISTER_NAPI, &napi, 1);
+}
+
+template <unsigned uring_flags>
+int uring<uring_flags>::register_buf_ring(io_uring_buf_reg &reg,
+                                          const unsigned flags) noexcept {
+  reg.flags |= flags;
+  return _register(IORING_REGISTER_PBUF_RING, &reg, 1);
+}
+
+template <unsigned uring_flags>
+int uring<uring_flags>::unregister_buf_ring(const uint16_t bgid) noexcept {
+  io_uring_buf_reg reg{
+      .bgid = bgid,
+  };
+  return _register(IORING_UNREGISTER_PBUF_RING, &reg, 1);
+}
+
+/*
+ * Read back how far the kernel has consumed the buffer ring of group bgid.
+ */
+template <unsigned uring_flags>
+int uring<uring_flags>::buf_ring_head(const uint16_t bgid,
+                                      uint16_t &head) noexcept {
+  io_uring_buf_status buf_status{
+      .buf_group = bgid,
+  };
+
+  const int ret = _register(IORING_REGISTER_PBUF_STATUS, &buf_status, 1);
+  if (ret) [[unlikely]] {
+    return ret;
+  }
+  head = static_cast<uint16_t>(buf_status.head);
+  return 0;
+}
+
+/*
+ * Ask the kernel which opcodes it supports. Meant to be called once at
+ * startup, the returned probe answers queries without further syscalls.
+ */
+template <unsigned uring_flags>
+probe uring<uring_flags>::get_probe() {
+  alignas(io_uring_probe) std::array<
+      char, sizeof(io_uring_probe) + probe::kMaxOps * sizeof(io_uring_probe_op)>
+      buf{};
+
+  const int ret = _register(IORING_REGISTER_PROBE, buf.data(), probe::kMaxOps);
+  if (ret) [[unlikely]] {
+    throw std::system_error{-ret, std::system_category(), "uring::get_probe"};
+  }
+  return probe{reinterpret_cast<const io_uring_probe *>(buf.data())};
+}
+
 template <unsigned uring_flags>
 int uring<uring_flags>::get_cqe(const cqe *(&cqe_ptr), unsigned submit,
                                 unsigned wait_nr, sigset_t *sigmask) noexcept {
@@ -236,6 +983,78 @@ int uring<uring_flags>::wait_cqe(const cqe *(&cqe_ptr)) noexcept {
   return wait_cqe_nr(cqe_ptr, 1);
 }
 
+/*
+ * Like wait_cqe_nr(), but gives up with -ETIME once ts has elapsed.
+ */
+template <unsigned uring_flags>
+int uring<uring_flags>::wait_cqes(const cqe *(&cqe_ptr), const unsigned wait_nr,
+                                  __kernel_timespec *ts,
+                                  sigset_t *sigmask) noexcept {
+  return _wait_cqes(cqe_ptr, false, wait_nr, ts, sigmask, false);
+}
+
+template <unsigned uring_flags>
+int uring<uring_flags>::wait_cqe_timeout(const cqe *(&cqe_ptr),
+                                         __kernel_timespec *ts) noexcept {
+  return wait_cqes(cqe_ptr, 1, ts, nullptr);
+}
+
+template <unsigned uring_flags>
+int uring<uring_flags>::submit_and_wait_timeout(const cqe *(&cqe_ptr),
+                                                const unsigned wait_nr,
+                                                __kernel_timespec *ts,
+                                                sigset_t *sigmask) noexcept {
+  return _wait_cqes(cqe_ptr, true, wait_nr, ts, sigmask, false);
+}
+
+/*
+ * The _until variants take an absolute deadline on the clock picked with
+ * register_clock(), CLOCK_MONOTONIC by default, instead of a relative
+ * timeout. A loop chasing a fixed deadline can then pass it straight
+ * through, rather than recomputing what is left of it on every iteration.
+ * Needs IORING_ENTER_ABS_TIMER, i.e. Linux 6.12, on kernels with
+ * IORING_FEAT_EXT_ARG.
+ */
+template <unsigned uring_flags>
+int uring<uring_flags>::wait_cqes_until(const cqe *(&cqe_ptr),
+                                        const unsigned wait_nr,
+                                        __kernel_timespec *deadline,
+                                        sigset_t *sigmask) noexcept {
+  return _wait_cqes(cqe_ptr, false, wait_nr, deadline, sigmask, true);
+}
+
+template <unsigned uring_flags>
+int uring<uring_flags>::wait_cqe_until(const cqe *(&cqe_ptr),
+                                       __kernel_timespec *deadline) noexcept {
+  return wait_cqes_until(cqe_ptr, 1, deadline, nullptr);
+}
+
+template <unsigned uring_flags>
+int uring<uring_flags>::submit_and_wait_until(const cqe *(&cqe_ptr),
+                                              const unsigned wait_nr,
+                                              __kernel_timespec *deadline,
+                                              sigset_t *sigmask) noexcept {
+  return _wait_cqes(cqe_ptr, true, wait_nr, deadline, sigmask, true);
+}
+
+/*
+ * Wait with the arguments in entry index of the registered wait region,
+ * see register_wait_region().
+ */
+template <unsigned uring_flags>
+int uring<uring_flags>::wait_cqes_reg(const cqe *(&cqe_ptr),
+                                      const unsigned wait_nr,
+                                      const unsigned index) noexcept {
+  return _wait_cqes_reg(cqe_ptr, 0, wait_nr, index);
+}
+
+template <unsigned uring_flags>
+int uring<uring_flags>::submit_and_wait_reg(const cqe *(&cqe_ptr),
+                                            const unsigned wait_nr,
+                                            const unsigned index) noexcept {
+  return _wait_cqes_reg(cqe_ptr, sq_.flush(), wait_nr, index);
+}
+
 template <unsigned uring_flags>
 int uring<uring_flags>::peek_cqe(const cqe *(&cqe_ptr)) noexcept {
   auto [cqe, nr_available, res] = _peek_cqe();
@@ -246,6 +1065,34 @@ int uring<uring_flags>::peek_cqe(const cqe *(&cqe_ptr)) noexcept {
   return wait_cqe_nr(cqe_ptr, 0);
 }
 
+/*
+ * Fill in an array of up to cqes.size() completions, without advancing the
+ * CQ head. The caller must mark them consumed with cq_advance() once done,
+ * which lets a whole batch be retired with a single head update.
+ */
+template <unsigned uring_flags>
+unsigned uring<uring_flags>::peek_batch_cqe(
+    std::span<const cqe *> cqes) noexcept {
+  bool overflow_checked = false;
+
+  while (true) {
+    if (const unsigned ret = cq_.peek_batch(cqes); ret) {
+      return ret;
+    }
+    if (overflow_checked || !cq_ring_needs_flush()) {
+      return 0;
+    }
+
+    /*
+     * Nothing in the ring, but the kernel has overflowed completions
+     * pending. Flush them into the CQ ring and have another look.
+     */
+    __sys_io_uring_enter(enter_ring_fd_, 0, 0,
+                         IORING_ENTER_GETEVENTS | enter_flags(), nullptr);
+    overflow_checked = true;
+  }
+}
+
 template <unsigned uring_flags>
 void uring<uring_flags>::seen_cqe([[maybe_unused]] const cqe *cqe) noexcept {
   assert(cqe);
@@ -260,6 +1107,114 @@ unsigned uring<uring_flags>::for_each(Fn fn) noexcept(
   return cq_.for_each(std::forward<Fn>(fn));
 }
 
+template <unsigned uring_flags>
+template <typename Fn>
+  requires std::invocable<Fn, cqe *>
+unsigned uring<uring_flags>::for_each_and_advance(Fn fn) noexcept(
+    std::is_nothrow_invocable_v<Fn, cqe *>) {
+  return cq_.for_each_and_advance(std::forward<Fn>(fn));
+}
+
+/*
+ * The command area of a URING_CMD SQE of this ring viewed as T. It is 16
+ * bytes, or 80 with IORING_SETUP_SQE128, where it runs on into the second
+ * half of the entry; a T that only fits the latter is rejected at compile
+ * time on a ring with 64 byte SQEs.
+ */
+template <unsigned uring_flags>
+template <typename T>
+  requires std::is_trivially_copyable_v<T>
+T *uring<uring_flags>::cmd_as(sqe &sqe) noexcept {
+  constexpr std::size_t cmd_size = uring_flags & IORING_SETUP_SQE128
+                                       ? sqe::kCmdMaxSize
+                                       : sqe::kCmdSize;
+  static_assert(sizeof(T) <= cmd_size, "T exceeds the SQE cmd area");
+  static_assert(alignof(T) <= alignof(io_uring_sqe));
+  return reinterpret_cast<T *>(sqe.cmd);
+}
+
+/*
+ * get_sqe() that submits to make room when the SQ is full, rather than
+ * failing. Returns nullptr only if the submission itself failed.
+ */
+template <unsigned uring_flags>
+template <sqe_policy policy>
+  requires(policy != sqe_policy::reap)
+sqe *uring<uring_flags>::get_sqe() noexcept {
+  if (sqe *sqe = sq_.get_sqe()) [[likely]] {
+    return sqe;
+  }
+  if constexpr (policy == sqe_policy::fail) {
+    return nullptr;
+  }
+
+  if (_make_room() < 0) [[unlikely]] {
+    return nullptr;
+  }
+  return sq_.get_sqe();
+}
+
+/*
+ * Like get_sqe<sqe_policy::submit>(), but completions are reaped into fn
+ * before submitting if the CQ may not have room for what is about to be
+ * submitted, and again if the kernel refuses the submission with -EBUSY
+ * because of overflowed completions. fn is taken by reference and both
+ * passes go to the same object, so a stateful handler sees every
+ * completion.
+ */
+template <unsigned uring_flags>
+template <sqe_policy policy, typename Fn>
+  requires(policy == sqe_policy::reap && std::invocable<Fn, cqe *>)
+sqe *uring<uring_flags>::get_sqe(Fn &&fn) noexcept(
+    std::is_nothrow_invocable_v<Fn, cqe *>) {
+  if (sqe *sqe = sq_.get_sqe()) [[likely]] {
+    return sqe;
+  }
+
+  if (_cq_near_overflow()) {
+    cq_.for_each_and_advance(std::ref(fn));
+  }
+  int ret = _make_room();
+  if (ret == -EBUSY) {
+    cq_.for_each_and_advance(std::ref(fn));
+    ret = _make_room();
+  }
+  if (ret < 0) [[unlikely]] {
+    return nullptr;
+  }
+  return sq_.get_sqe();
+}
+
+/*
+ * Submit whatever is queued so the SQ has room again. With SQPOLL the
+ * poller thread owns submission, so wait for it to consume entries
+ * instead.
+ */
+template <unsigned uring_flags>
+int uring<uring_flags>::_make_room() noexcept {
+  const int ret = submit();
+  if constexpr (uring_flags & IORING_SETUP_SQPOLL) {
+    if (ret >= 0 && !sq_.space_left()) {
+      return __sys_io_uring_enter(enter_ring_fd_, 0, 0,
+                                  enter_flags() | IORING_ENTER_SQ_WAIT,
+                                  nullptr);
+    }
+  }
+  return ret;
+}
+
+/*
+ * Whether submitting a full SQ could push the CQ past its end, or the
+ * kernel already had to stash completions in its overflow list.
+ */
+template <unsigned uring_flags>
+bool uring<uring_flags>::_cq_near_overflow() const noexcept {
+  if (IO_URING_READ_ONCE(*sq_.kflags_) & IORING_SQ_CQ_OVERFLOW) {
+    return true;
+  }
+  return cq_.ready() + sq_.ring_entries_ > cq_.ring_entries_;
+}
+
 template <unsigned uring_flags>
 bool uring<uring_flags>::sq_ring_needs_enter(const unsigned submit,
                                              unsigned &flags) noexcept {
@@ -285,6 +1240,22 @@ bool uring<uring_flags>::sq_ring_needs_enter(const unsigned submit,
   return false;
 }
 
+/*
+ * Called once per submission, after sq_ring_needs_enter() has decided on
+ * IORING_ENTER_SQ_WAKEUP: the predicate itself is also evaluated on every
+ * pass of the wait loops, which would count the same SQEs again.
+ */
+template <unsigned uring_flags>
+void uring<uring_flags>::_count_sqpoll(const unsigned submit,
+                                       const unsigned flags) noexcept {
+  if constexpr (uring_flags & IORING_SETUP_SQPOLL) {
+    if (submit) {
+      ++sqpoll_stats_.submits;
+      sqpoll_stats_.wakeups += !!(flags & IORING_ENTER_SQ_WAKEUP);
+    }
+  }
+}
+
 template <unsigned uring_flags>
 bool uring<uring_flags>::cq_ring_needs_flush() noexcept {
   return IO_URING_READ_ONCE(*sq_.kflags_) &
@@ -345,7 +1316,7 @@ void uring<uring_flags>::alloc_huge(const unsigned entries,
 
   sq_.sqes_ = static_cast<sqe *>(ptr);
   if (mem_used <= buf_size) {
-    sq_.ring_ptr_ = sq_.sqes_ + sqes_mem;
+    sq_.ring_ptr_ = reinterpret_cast<char *>(sq_.sqes_) + sqes_mem;
     sq_.ring_sz_ = 0;
     cq_.ring_sz_ = 0;
   } else {
@@ -442,13 +1413,56 @@ std::pair<unsigned, unsigned> uring<uring_flags>::get_sq_cq_entries(
   return {entries, cq_entries};
 }
 
+template <unsigned uring_flags>
+int uring<uring_flags>::_register(unsigned opcode, const void *arg,
+                                  const unsigned nr_args) noexcept {
+  int fd;
+
+  if (int_flags_ & INT_FLAG_REG_REG_RING) {
+    opcode |= IORING_REGISTER_USE_REGISTERED_RING;
+    fd = enter_ring_fd_;
+  } else {
+    fd = ring_fd_;
+  }
+
+  return __sys_io_uring_register(fd, opcode, arg, nr_args);
+}
+
+/*
+ * The kernel accounts a file table against RLIMIT_NOFILE. If that is what
+ * failed, raise the soft limit once and retry.
+ */
+template <unsigned uring_flags>
+int uring<uring_flags>::_register_files(const unsigned opcode, const void *arg,
+                                        const unsigned nr_args,
+                                        const unsigned nr_files) noexcept {
+  int ret = _register(opcode, arg, nr_args);
+  if (ret != -EMFILE) [[likely]] {
+    return ret;
+  }
+
+  rlimit rlim{};
+  if (__sys_getrlimit(RLIMIT_NOFILE, &rlim) < 0) {
+    return ret;
+  }
+  if (rlim.rlim_cur < nr_files) {
+    rlim.rlim_cur += nr_files;
+    __sys_setrlimit(RLIMIT_NOFILE, &rlim);
+  }
+
+  return _register(opcode, arg, nr_args);
+}
+
 template <unsigned uring_flags>
 int uring<uring_flags>::_submit(const unsigned submitted, unsigned wait_nr,
                                 bool getevents) noexcept {
   const bool cq_needs_enter = getevents || wait_nr || cq_ring_needs_enter();
   unsigned flags = enter_flags();
 
-  if (sq_ring_needs_enter(submitted, flags) || cq_needs_enter) {
+  const bool sq_needs_enter = sq_ring_needs_enter(submitted, flags);
+  _count_sqpoll(submitted, flags);
+
+  if (sq_needs_enter || cq_needs_enter) {
     if (cq_needs_enter) {
       flags |= IORING_ENTER_GETEVENTS;
     }
@@ -459,6 +1473,77 @@ int uring<uring_flags>::_submit(const unsigned submitted, unsigned wait_nr,
   return static_cast<int>(submitted);
 }
 
+/*
+ * Uses IORING_ENTER_EXT_ARG if the kernel has it, otherwise an internal
+ * timeout SQE is queued. Its completion is consumed by whichever of
+ * _peek_cqe() or the cq's batch reaping reaches it first.
+ */
+template <unsigned uring_flags>
+int uring<uring_flags>::_wait_cqes(const cqe *(&cqe_ptr), const bool submit,
+                                   const unsigned wait_nr,
+                                   __kernel_timespec *ts, sigset_t *sigmask,
+                                   const bool abs) noexcept {
+  unsigned to_submit = 0;
+
+  if (ts) {
+    if (features_ & IORING_FEAT_EXT_ARG) [[likely]] {
+      return _wait_cqes_ext_arg(cqe_ptr, submit ? sq_.flush() : 0, wait_nr,
+                                ts, sigmask, abs ? IORING_ENTER_ABS_TIMER : 0);
+    }
+    const int ret = _submit_timeout(wait_nr, ts, abs);
+    if (ret < 0) [[unlikely]] {
+      return ret;
+    }
+    to_submit = ret;
+  } else if (submit) {
+    to_submit = sq_.flush();
+  }
+
+  /*
+   * If the enter already returned the number of submitted SQEs, the -ETIME
+   * of the internal timeout does not make it out of _get_cqe(); a wait
+   * that comes back without a CQE timed out.
+   */
+  const int ret = get_cqe(cqe_ptr, to_submit, wait_nr, sigmask);
+  if (ts && !cqe_ptr && ret >= 0) {
+    return -ETIME;
+  }
+  return ret;
+}
+
+/*
+ * Fallback for kernels without IORING_FEAT_EXT_ARG: queue a timeout SQE
+ * that completes after wait_nr events or ts, whichever comes first.
+ */
+template <unsigned uring_flags>
+int uring<uring_flags>::_submit_timeout(const unsigned wait_nr,
+                                        __kernel_timespec *ts,
+                                        const bool abs) noexcept {
+  /*
+   * If the SQ ring is full, we may need to submit IO first
+   */
+  sqe *sqe = sq_.get_sqe();
+  if (!sqe) {
+    const int ret = submit();
+    if (ret < 0) [[unlikely]] {
+      return ret;
+    }
+    sqe = sq_.get_sqe();
+    if (!sqe) [[unlikely]] {
+      return -EAGAIN;
+    }
+  }
+
+  unsigned flags = abs ? IORING_TIMEOUT_ABS : 0;
+  if (int_flags_ & INT_FLAG_BOOTTIME) {
+    flags |= IORING_TIMEOUT_BOOTTIME;
+  }
+  sqe->prep_timeout(ts, wait_nr, flags);
+  sqe->set_data(LIBURING_UDATA_TIMEOUT);
+  ++cq_.internal_timeouts_;
+  return static_cast<int>(sq_.flush());
+}
+
 template <unsigned uring_flags>
 typename uring<uring_flags>::_peek_return_type
 uring<uring_flags>::_peek_cqe() noexcept {
@@ -475,9 +1560,9 @@ uring<uring_flags>::_peek_cqe() noexcept {
     }
 
     ret._cqe = &cq_.at(head);
-    if (!(features_ & IORING_FEAT_EXT_ARG) &&
-        ret._cqe->user_data == LIBURING_UDATA_TIMEOUT) [[unlikely]] {
+    if (cq_._is_internal(ret._cqe)) [[unlikely]] {
       ret.res = ret._cqe->res < 0 ? ret._cqe->res : 0;
+      --cq_.internal_timeouts_;
       cq_.advance(1);
       if (!ret.res) {
         continue;
@@ -528,13 +1613,23 @@ int uring<uring_flags>::_get_cqe(
       need_enter = true;
     }
     if (sq_ring_needs_enter(data.submit, flags)) need_enter = true;
+    if (!looped) {
+      _count_sqpoll(data.submit, flags);
+    }
     if (!need_enter) {
       break;
     }
     if constexpr (has_ts) {
       if (looped) {
-        io_uring_getevents_arg *arg = data.arg;
-        if (!cqe && arg->ts && !err) {
+        bool timed;
+        if (data.get_flags & IORING_ENTER_EXT_ARG_REG) {
+          const auto off = reinterpret_cast<uintptr_t>(data.arg);
+          timed = reg_wait_[off / sizeof(io_uring_reg_wait)].flags &
+                  IORING_REG_WAIT_TS;
+        } else {
+          timed = static_cast<io_uring_getevents_arg *>(data.arg)->ts;
+        }
+        if (!cqe && timed && !err) {
           err = -ETIME;
         }
         break;
@@ -561,6 +1656,50 @@ int uring<uring_flags>::_get_cqe(
   return err;
 }
 
+template <unsigned uring_flags>
+int uring<uring_flags>::_wait_cqes_ext_arg(const cqe *(&cqe_ptr),
+                                           const unsigned submit,
+                                           const unsigned wait_nr,
+                                           __kernel_timespec *ts,
+                                           sigset_t *sigmask,
+                                           const unsigned get_flags) noexcept {
+  io_uring_getevents_arg arg{
+      .sigmask = reinterpret_cast<uintptr_t>(sigmask),
+      .sigmask_sz = _NSIG / 8,
+      .min_wait_usec = 0,
+      .ts = reinterpret_cast<uintptr_t>(ts),
+  };
+  typename cq<uring_flags>::get_data data{
+      .submit = submit,
+      .wait_nr = wait_nr,
+      .get_flags = IORING_ENTER_EXT_ARG | get_flags,
+      .sz = sizeof(arg),
+      .arg = &arg,
+  };
+  return _get_cqe<true>(cqe_ptr, data);
+}
+
+/*
+ * With IORING_ENTER_EXT_ARG_REG, the argument is the byte offset of the
+ * entry in the registered wait region rather than a pointer.
+ */
+template <unsigned uring_flags>
+int uring<uring_flags>::_wait_cqes_reg(const cqe *(&cqe_ptr),
+                                       const unsigned submit,
+                                       const unsigned wait_nr,
+                                       const unsigned index) noexcept {
+  assert(index < reg_wait_nr_ && "wait region index out of range");
+
+  typename cq<uring_flags>::get_data data{
+      .submit = submit,
+      .wait_nr = wait_nr,
+      .get_flags = IORING_ENTER_EXT_ARG | IORING_ENTER_EXT_ARG_REG,
+      .sz = sizeof(io_uring_reg_wait),
+      .arg = reinterpret_cast<void *>(index * sizeof(io_uring_reg_wait)),
+  };
+  return _get_cqe<true>(cqe_ptr, data);
+}
+
 }  // namespace liburing
 
 #endif  // URING_URING_H